@@ -1,310 +1,1058 @@
 #include "filesys/cache.h"
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <bitmap.h>
+#include <round.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/loader.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "devices/timer.h"
 
-#define MAX_CACHE_SIZE 64
+/* Sectors held in kernel pool pages, never given back. */
+#define CACHE_BASE_SIZE 64
+/* Default upper bound of buffer cache in sectors (256 kB). */
+#define DEFAULT_CACHE_SIZE 512
 #define CACHE_FLUSH_INTERVAL 100
+/* Ticks between checks of dirty ratio by flusher. */
+#define CACHE_FLUSH_TICK 10
+/* Dirty entries older than this many ticks are written back. */
+#define CACHE_DIRTY_AGE 100
+/* Percentage of dirty sectors in cache forcing write-back. */
+#define CACHE_DIRTY_RATIO 25
+/* Max number of sectors written back at once by flusher. */
+#define CACHE_FLUSH_BATCH 64
 
-static struct list cache_list;
-static void* buffer_cache;
-static struct bitmap* cache_bmap;
-static struct lock cache_lock;
-static struct lock cell_lock[MAX_CACHE_SIZE];
+/* Number of sectors held by a single buffer cache page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Number of independently locked portions of buffer cache. */
+#define CACHE_SHARDS 8
+
+/* Max number of sectors waiting for read-ahead. */
+#define READ_AHEAD_QUEUE 64
+
+/* How cache_get() treats a sector missing in buffer cache. */
+enum cache_fill
+{
+	FILL_READ,		/* Read it from disk */
+	FILL_NONE,		/* Caller overwrites it entirely */
+	FILL_AHEAD		/* Read it from disk for read-ahead */
+};
+
+/* Replacement policy of buffer cache. */
+enum cache_policy
+{
+	CACHE_CLOCK,	/* Second chance over all entries */
+	CACHE_2Q			/* 2Q: FIFO probation, second chance hot list, ghost list */
+};
+
+/* Portion of buffer cache holding the sectors mapped into it.
+	 Device I/O is never done while holding the shard lock, except
+	 in cache_writeback() and cache_shrink(). */
+struct cache_shard
+{
+	struct lock lock;						/* Shard synchronization */
+	struct hash table;					/* Entries indexed by sector */
+	struct list clock;					/* Hot entries in second chance order */
+	struct list probation;			/* 2Q: entries seen once, in FIFO order */
+	struct condition io_done;		/* Signaled on I/O completion or unpin */
+	size_t dirty_cnt;						/* Number of dirty entries */
+	struct cache_stats stats;		/* Counters of events in this shard */
+
+	/* 2Q: ring of sectors recently evicted from probation */
+	block_sector_t* ghost;
+	size_t ghost_head;
+	size_t ghost_cnt;
+};
+
+static struct cache_shard shards[CACHE_SHARDS];
+static struct cache* cache_entries;							/* Entry of each buffer slot */
+static size_t cache_size = DEFAULT_CACHE_SIZE;	/* Max number of sectors */
+static size_t base_pages;												/* Pages from kernel pool */
+static void** cache_pages;											/* Buffer pages, NULL if absent */
+static struct bitmap* cache_bmap;								/* Set if slot used or absent */
+static struct lock slot_lock;										/* Slot bitmap and pages */
+static struct lock owner_lock;									/* Owner of every entry */
 static bool cache_runbit;
-static block_sector_t ahead_sector;
+static enum cache_policy policy = CACHE_CLOCK;	/* Replacement policy */
+static size_t ghost_size;												/* Ghost ring capacity */
+
+/* Read-ahead request queue, ring buffer of sectors */
+static block_sector_t ahead_queue[READ_AHEAD_QUEUE];
+static size_t ahead_head;
+static size_t ahead_cnt;
 static struct lock ahead_lock;
+static struct condition ahead_ready;
+static unsigned long long ahead_dropped;	/* Requests dropped, full queue */
 
-static struct cache* allocate_cache(block_sector_t sector, block_sector_t next_sector);
-static struct cache* scan_cache(block_sector_t sector);
+static struct cache* cache_get(block_sector_t sector, enum cache_fill fill,
+															 struct cache_owner* owner);
+static void disown(struct cache* cache);
+static void cache_put(struct cache* cache, bool dirtied);
+static struct cache* allocate_cache(struct cache_shard* shard);
+static struct cache* scan_cache(struct cache_shard* shard, block_sector_t sector);
+static void insert_entry(struct cache_shard* shard, struct cache* cache);
 static void flush_cache(void* aux UNUSED);
+static void read_ahead(void* aux UNUSED);
+static unsigned cache_hash(const struct hash_elem* e, void* aux UNUSED);
+static bool cache_less(const struct hash_elem* a,
+											 const struct hash_elem* b, void* aux UNUSED);
+
+/* Largest upper bound of buffer cache in sectors: a quarter of RAM.
+	 Entries of every slot are allocated from kernel heap at once, about
+	 a fifth of the buffer size, which the kernel pool of half of RAM
+	 can spare; buffer pages beyond the base come from user pool later. */
+size_t 
+cache_max_size(void)
+{
+	return init_ram_pages / 4 * SECTORS_PER_PAGE;
+}
+
+/* Set upper bound of buffer cache to SECTORS sectors.
+	 Must be called before cache_init(). Returns false, changing
+	 nothing, if SECTORS is 0 or above cache_max_size(). */
+bool 
+cache_set_size(size_t sectors)
+{
+	if(sectors == 0 || sectors > cache_max_size())
+		return false;
+	if(sectors < SECTORS_PER_PAGE)
+		sectors = SECTORS_PER_PAGE;
+	cache_size = ROUND_UP(sectors, SECTORS_PER_PAGE);
+	return true;
+}
+
+/* Select replacement policy by NAME, "clock" or "2q".
+	 Must be called before cache_init(). Returns false if unknown. */
+bool 
+cache_set_policy(const char* name)
+{
+	if(!strcmp(name, "clock"))
+		policy = CACHE_CLOCK;
+	else if(!strcmp(name, "2q"))
+		policy = CACHE_2Q;
+	else
+		return false;
+	return true;
+}
 
 void 
 cache_init(void)
 {
-	int i;
+	size_t i;
+	size_t page_cnt = cache_size / SECTORS_PER_PAGE;
 
-	list_init(&cache_list);
-	lock_init(&cache_lock);
-	buffer_cache = palloc_get_multiple(PAL_ASSERT, MAX_CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
-	cache_bmap = bitmap_create(MAX_CACHE_SIZE);
+	/* Ghosts remember as many sectors as half of the shard holds */
+	ghost_size = cache_size / CACHE_SHARDS / 2;
+	if(ghost_size == 0)
+		ghost_size = 1;
 
-	for(i = 0; i < MAX_CACHE_SIZE; i++)
-		lock_init(&cell_lock[i]);
+	for(i = 0; i < CACHE_SHARDS; i++)
+	{
+		lock_init(&shards[i].lock);
+		hash_init(&shards[i].table, cache_hash, cache_less, NULL);
+		list_init(&shards[i].clock);
+		list_init(&shards[i].probation);
+		cond_init(&shards[i].io_done);
+		if(policy == CACHE_2Q)
+		{
+			shards[i].ghost = calloc(ghost_size, sizeof *shards[i].ghost);
+			if(shards[i].ghost == NULL)
+				PANIC("buffer cache creation failed");
+		}
+	}
+	lock_init(&slot_lock);
+	lock_init(&owner_lock);
+
+	cache_pages = calloc(page_cnt, sizeof *cache_pages);
+	cache_entries = calloc(cache_size, sizeof *cache_entries);
+	cache_bmap = bitmap_create(cache_size);
+	if(cache_pages == NULL || cache_entries == NULL || cache_bmap == NULL)
+		PANIC("buffer cache creation failed");
+
+	/* Only base pages are present at first,
+		 the rest is taken from user pool on demand */
+	bitmap_set_all(cache_bmap, true);
+	base_pages = DIV_ROUND_UP(CACHE_BASE_SIZE, SECTORS_PER_PAGE);
+	if(base_pages > page_cnt)
+		base_pages = page_cnt;
+	for(i = 0; i < base_pages; i++)
+	{
+		cache_pages[i] = palloc_get_page(PAL_ASSERT);
+		bitmap_set_multiple(cache_bmap, i * SECTORS_PER_PAGE, SECTORS_PER_PAGE, false);
+	}
+
+	for(i = 0; i < cache_size; i++)
+	{
+		cache_entries[i].bufpos = i;
+		lock_init(&cache_entries[i].lock);
+	}
 
 	/* Create Flusher thread */
 	thread_create("cache_flusher", PRI_DEFAULT, flush_cache, NULL);
 
-	ahead_sector = UINT32_MAX;
+	/* Create Read-ahead thread */
 	lock_init(&ahead_lock);
+	cond_init(&ahead_ready);
+	thread_create("read_aheader", PRI_DEFAULT, read_ahead, NULL);
 }
 
 /* Translate buffer position to actual buffer cache address */
 static inline void* 
 bufpos_to_addr(size_t bufpos)
 {
-	return buffer_cache + (BLOCK_SECTOR_SIZE * bufpos);
+	return cache_pages[bufpos / SECTORS_PER_PAGE]
+				 + (BLOCK_SECTOR_SIZE * (bufpos % SECTORS_PER_PAGE));
 }
 
-/* Try to read SECTOR in cache into BUFFER by SIZE. 
-	 If not exists, cache SECTOR into buffer cache then read */
-void 
-cache_read(block_sector_t sector, uint8_t* buffer, 
-					 size_t size, off_t ofs, block_sector_t next_sector)
+/* Shard in charge of SECTOR */
+static inline struct cache_shard* 
+shard_of(block_sector_t sector)
 {
-	struct cache* cache;
+	return &shards[sector % CACHE_SHARDS];
+}
 
-	lock_acquire(&cache_lock);
-	/* Get buffer cache metadata */
-	cache = scan_cache(sector);
-	if(cache == NULL)
-		cache = allocate_cache(sector, next_sector);
+/* Initialize OWNER as owning no entry */
+void 
+cache_owner_init(struct cache_owner* owner)
+{
+	list_init(&owner->entries);
+}
 
-	lock_release(&cache_lock);
-	lock_acquire(&cell_lock[cache->bufpos]);
+/* Try to read SECTOR in cache into BUFFER by SIZE.
+	 If not exists, cache SECTOR into buffer cache then read.
+	 SECTOR is recorded as belonging to OWNER, if not null. */
+void 
+cache_read(block_sector_t sector, uint8_t* buffer, size_t size, off_t ofs,
+					 struct cache_owner* owner)
+{
+	struct cache* cache = cache_get(sector, FILL_READ, owner);
 
+	lock_acquire(&cache->lock);
   /* Mark referenced */
   cache->ref = true;
 
 	/* Read from buffer cache into BUFFER */
 	memcpy(buffer, bufpos_to_addr(cache->bufpos) + ofs, size);
-	lock_release(&cell_lock[cache->bufpos]);
+	lock_release(&cache->lock);
+
+	cache_put(cache, false);
 }
 
-/* Try to write to SECTOR in cache from BUFFER by SIZE. 
-	 If not exists, cache SECTOR into buffer cache then write */
+/* Try to write to SECTOR in cache from BUFFER by SIZE.
+	 If not exists, cache SECTOR into buffer cache then write.
+	 A write of the whole sector does not read it from disk first.
+	 SECTOR is recorded as belonging to OWNER, if not null. */
 void 
-cache_write(block_sector_t sector, const uint8_t* buffer, 
-						size_t size, off_t ofs, block_sector_t next_sector)
+cache_write(block_sector_t sector, const uint8_t* buffer, size_t size, off_t ofs,
+						struct cache_owner* owner)
+{
+	bool full = ofs == 0 && size == BLOCK_SECTOR_SIZE;
+	struct cache* cache = cache_get(sector, full ? FILL_NONE : FILL_READ, owner);
+
+	lock_acquire(&cache->lock);
+	/* Mark referenced, dirty bit is set on unpin */
+	cache->ref = true;
+
+	/* Write BUFFER data into buffer cache */
+	memcpy(bufpos_to_addr(cache->bufpos) + ofs, buffer, size);
+	lock_release(&cache->lock);
+
+	cache_put(cache, true);
+}
+
+/* Find SECTOR in buffer cache, caching it on miss, and pin it
+	 so that it cannot be evicted until cache_put().
+	 Concurrent requesters of a sector being read wait for the
+	 first one instead of reading it again.
+	 With FILL_NONE, a missing sector is not read from disk: the caller
+	 must overwrite it entirely, and the entry stays in-flight for
+	 everyone else until cache_put().
+	 The entry is added to entries of OWNER, if not null. */
+static struct cache* 
+cache_get(block_sector_t sector, enum cache_fill fill, struct cache_owner* owner)
 {
+	struct cache_shard* shard = shard_of(sector);
 	struct cache* cache;
 
-	lock_acquire(&cache_lock);
-	/* Get buffer cache metadata */
-	cache = scan_cache(sector);
-	if(cache == NULL)
-		cache = allocate_cache(sector, next_sector);
+	lock_acquire(&shard->lock);
+	while(true)
+	{
+		cache = scan_cache(shard, sector);
+		if(cache != NULL)
+		{
+			if(cache->io)
+			{
+				cond_wait(&shard->io_done, &shard->lock);
+				continue;
+			}
+			if(fill != FILL_AHEAD)
+			{
+				shard->stats.hits++;
+				if(cache->ahead)
+					shard->stats.ahead_hits++;
+				cache->ahead = false;
+			}
+			break;
+		}
 
-	lock_release(&cache_lock);
-	lock_acquire(&cell_lock[cache->bufpos]);
+		/* Shard lock may be dropped meanwhile, then look up again */
+		cache = allocate_cache(shard);
+		if(cache == NULL)
+			continue;
 
-  /* Mark referenced */
-  cache->ref = true;
+		/* Install entry as in-flight, then read without shard lock */
+		cache->sector = sector;
+		cache->dirty = false;
+		cache->ref = false;
+		cache->io = true;
+		cache->ahead = fill == FILL_AHEAD;
+		cache->owner = NULL;
+		cache->pin_cnt = 0;
+		hash_insert(&shard->table, &cache->helem);
+		insert_entry(shard, cache);
+		if(fill == FILL_NONE)
+		{
+			shard->stats.overwrites++;
+			break;
+		}
+		if(fill == FILL_AHEAD)
+			shard->stats.ahead_reads++;
+		else
+			shard->stats.misses++;
+		lock_release(&shard->lock);
 
-	/* Mark as dirty */
-	cache->dirty = true;
-	cache->ref = true;
+		block_read(fs_device, sector, bufpos_to_addr(cache->bufpos));
 
-	/* Write BUFFER data into buffer cache */
-	memcpy(bufpos_to_addr(cache->bufpos) + ofs, buffer, size);	
-	lock_release(&cell_lock[cache->bufpos]);
+		lock_acquire(&shard->lock);
+		cache->io = false;
+		cond_broadcast(&shard->io_done, &shard->lock);
+		break;
+	}
+	cache->pin_cnt++;
+
+	/* Move entry to OWNER from previous owner, if any */
+	if(owner != NULL && cache->owner != owner)
+	{
+		lock_acquire(&owner_lock);
+		if(cache->owner != NULL)
+			list_remove(&cache->owner_elem);
+		cache->owner = owner;
+		list_push_back(&owner->entries, &cache->owner_elem);
+		lock_release(&owner_lock);
+	}
+	lock_release(&shard->lock);
+
+	return cache;
 }
 
-static struct cache* evict_cache(void);
+/* Unpin CACHE pinned by cache_get(), marking it dirty if DIRTIED */
+static void 
+cache_put(struct cache* cache, bool dirtied)
+{
+	struct cache_shard* shard = shard_of(cache->sector);
 
-/* Scan cache to search empty space.
-	 Evict if cache is full, then allocate cache
-	 Write sector data into buffer cache at the end */
+	lock_acquire(&shard->lock);
+	ASSERT(cache->pin_cnt > 0);
+	/* Entry installed without fill is now valid */
+	if(cache->io)
+	{
+		ASSERT(dirtied && cache->pin_cnt == 1);
+		cache->io = false;
+		cond_broadcast(&shard->io_done, &shard->lock);
+	}
+	if(dirtied && !cache->dirty)
+	{
+		cache->dirty = true;
+		cache->dirty_time = timer_ticks();
+		shard->dirty_cnt++;
+	}
+	if(--cache->pin_cnt == 0)
+		cond_broadcast(&shard->io_done, &shard->lock);
+	lock_release(&shard->lock);
+}
+
+static struct cache* evict_cache(struct cache_shard* shard);
+static void evict_entry(struct cache_shard* shard, struct cache* cache);
+
+/* Add one page from user pool to buffer cache.
+	 Returns false if cache is at its bound or user pool is exhausted. */
+static bool 
+grow_cache(void)
+{
+	size_t i;
+
+	ASSERT(lock_held_by_current_thread(&slot_lock));
+
+	for(i = base_pages; i < cache_size / SECTORS_PER_PAGE; i++)
+		if(cache_pages[i] == NULL)
+		{
+			cache_pages[i] = palloc_get_page(PAL_USER);
+			if(cache_pages[i] == NULL)
+				return false;
+			bitmap_set_multiple(cache_bmap, i * SECTORS_PER_PAGE, SECTORS_PER_PAGE, false);
+			return true;
+		}
+	return false;
+}
+
+/* Write back dirty VICTIM of SHARD without holding shard lock.
+	 VICTIM is marked in-flight so that nobody uses it meanwhile. */
+static void 
+writeback_victim(struct cache_shard* shard, struct cache* victim)
+{
+	ASSERT(lock_held_by_current_thread(&shard->lock));
+	ASSERT(!victim->io && victim->pin_cnt == 0);
+
+	victim->io = true;
+	lock_release(&shard->lock);
+
+	block_write(fs_device, victim->sector, bufpos_to_addr(victim->bufpos));
+
+	lock_acquire(&shard->lock);
+	shard->stats.writebacks++;
+	victim->dirty = false;
+	victim->io = false;
+	shard->dirty_cnt--;
+	cond_broadcast(&shard->io_done, &shard->lock);
+}
+
+/* Find an entry not belonging to any shard, for SHARD to use.
+	 Take empty space, grow cache if possible, evict if cache is full.
+	 Returns a null pointer if shard lock had to be dropped,
+	 in which case the caller must look up its sector again. */
 static struct cache* 
-allocate_cache(block_sector_t sector, block_sector_t next_sector)
+allocate_cache(struct cache_shard* shard)
 {
 	struct cache* cache;
-	size_t cache_pos;	
+	size_t cache_pos;
+	size_t i;
+
+	ASSERT(lock_held_by_current_thread(&shard->lock));
 
-	ASSERT(lock_held_by_current_thread(&cache_lock));
-	
+	lock_acquire(&slot_lock);
 	cache_pos = bitmap_scan_and_flip(cache_bmap, 0, 1, false);
- 
-	/* Evict if cache is full */
-	if(cache_pos == BITMAP_ERROR)
-		cache = evict_cache();
-	else
+	if(cache_pos == BITMAP_ERROR && grow_cache())
+		cache_pos = bitmap_scan_and_flip(cache_bmap, 0, 1, false);
+	lock_release(&slot_lock);
+	if(cache_pos != BITMAP_ERROR)
+		return &cache_entries[cache_pos];
+
+	/* Evict from own shard */
+	cache = evict_cache(shard);
+	if(cache != NULL)
 	{
-		cache = malloc(sizeof(struct cache));
-		cache->bufpos = cache_pos;
+		if(cache->dirty)
+		{
+			writeback_victim(shard, cache);
+			return NULL;
+		}
+		evict_entry(shard, cache);
+		return cache;
 	}
-	cache->dirty = false;
-  cache->ref = true;
-	cache->sector = sector;
-	cache->ref = false;
-	lock_acquire(&cell_lock[cache->bufpos]);
-	block_read(fs_device, sector, bufpos_to_addr(cache->bufpos));
-	lock_release(&cell_lock[cache->bufpos]);
-	list_push_back(&cache_list, &cache->elem);
 
-	cache_install(next_sector);
+	/* Own shard has nothing to give, take from others if not busy */
+	for(i = 1; i < CACHE_SHARDS; i++)
+	{
+		struct cache_shard* other = &shards[(shard - shards + i) % CACHE_SHARDS];
 
-	return cache;
+		if(!lock_try_acquire(&other->lock))
+			continue;
+		cache = evict_cache(other);
+		if(cache == NULL)
+		{
+			lock_release(&other->lock);
+			continue;
+		}
+		if(cache->dirty)
+		{
+			lock_release(&shard->lock);
+			writeback_victim(other, cache);
+			lock_release(&other->lock);
+			lock_acquire(&shard->lock);
+			return NULL;
+		}
+		evict_entry(other, cache);
+		lock_release(&other->lock);
+		return cache;
+	}
+
+	/* Every entry is in use, let the others proceed */
+	lock_release(&shard->lock);
+	thread_yield();
+	lock_acquire(&shard->lock);
+	return NULL;
 }
 
-/* Return position of block evicted.
+/* Return oldest entry of LIST neither pinned nor in-flight,
+	 or a null pointer if none */
+static struct cache* 
+first_idle(struct list* list)
+{
+	struct list_elem* e;
+
+	for(e = list_begin(list); e != list_end(list); e = list_next(e))
+	{
+		struct cache* cache = list_entry(e, struct cache, elem);
+		if(!cache->io && cache->pin_cnt == 0)
+			return cache;
+	}
+	return NULL;
+}
+
+/* Return entry of SHARD to be evicted, or a null pointer if every
+	 entry is pinned or in-flight.
    The evict policy is along with second chance algorithm.
-	 Write back to disk when block content is dirty. */
+	 With 2Q, entries seen once go first while they take more than
+	 a quarter of the shard, so that a scan cannot push hot entries out. */
 static struct cache* 
-evict_cache(void)
+evict_cache(struct cache_shard* shard)
 {
-	struct cache* cache;	
+	struct cache* cache;
   struct list_elem* e;
+	int pass;
 
-	ASSERT(bitmap_all(cache_bmap, 0, MAX_CACHE_SIZE));
-	ASSERT(list_size(&cache_list) == MAX_CACHE_SIZE);
-	ASSERT(lock_held_by_current_thread(&cache_lock));
+	ASSERT(lock_held_by_current_thread(&shard->lock));
+
+	if(policy == CACHE_2Q && list_size(&shard->probation) * 4 > hash_size(&shard->table))
+	{
+		cache = first_idle(&shard->probation);
+		if(cache != NULL)
+			return cache;
+	}
 
   /* Iterate on each elemt unless we find proper victim */
-  e = list_begin(&cache_list);
-  while(true)
-  {
-    if(e == list_end(&cache_list))
-      e = list_begin(&cache_list);
-    cache = list_entry(e, struct cache, elem);
-
-    /* If the buffer cache is recently accessed, then move on to the next cache */
-    if(cache->ref)
-    {
-      cache->ref = false;
-      /* Advance */
-      e = list_next (e);
-      continue;
-    }
-
-		list_remove(&cache->elem);
-
-    /* Write behind */
-    lock_acquire(&cell_lock[cache->bufpos]);
-    if(cache->dirty)
-      block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
-    lock_release(&cell_lock[cache->bufpos]);
-
-    break;
-  }
+	for(pass = 0; pass < 2; pass++)
+		for(e = list_begin(&shard->clock); e != list_end(&shard->clock);
+				e = list_next(e))
+		{
+			cache = list_entry(e, struct cache, elem);
+			if(cache->io || cache->pin_cnt > 0)
+				continue;
 
-	return cache;
+			/* If the buffer cache is recently accessed, then move on to the next cache */
+			if(cache->ref)
+			{
+				cache->ref = false;
+				continue;
+			}
+			return cache;
+		}
+
+	return first_idle(&shard->probation);
 }
 
-/* Scan buffer cache header list
-	 Return cache struct if sector is in cache, NULL otherwise */
-static struct cache* 
-scan_cache(block_sector_t sector)
+/* Put SECTOR evicted from probation of SHARD into its ghost ring,
+	 forgetting the oldest ghost if full */
+static void 
+ghost_push(struct cache_shard* shard, block_sector_t sector)
 {
-	struct cache* cache;
-	struct list_elem* e;
+	if(shard->ghost_cnt == ghost_size)
+	{
+		shard->ghost_head = (shard->ghost_head + 1) % ghost_size;
+		shard->ghost_cnt--;
+	}
+	shard->ghost[(shard->ghost_head + shard->ghost_cnt++) % ghost_size] = sector;
+}
 
-	ASSERT(lock_held_by_current_thread(&cache_lock));
+/* Remove SECTOR from ghost ring of SHARD.
+	 Returns true if it was there, i.e. it was evicted from probation
+	 recently and is being reused. */
+static bool 
+ghost_remove(struct cache_shard* shard, block_sector_t sector)
+{
+	size_t i;
 
-	for(e = list_begin(&cache_list); e != list_end(&cache_list); 
-			e = list_next(e))
+	for(i = 0; i < shard->ghost_cnt; i++)
 	{
-		cache = list_entry(e, struct cache, elem);
-		if(cache->sector == sector)
-			return cache;
+		size_t pos = (shard->ghost_head + i) % ghost_size;
+		if(shard->ghost[pos] == sector)
+		{
+			/* Oldest ghost fills the hole */
+			shard->ghost[pos] = shard->ghost[shard->ghost_head];
+			shard->ghost_head = (shard->ghost_head + 1) % ghost_size;
+			shard->ghost_cnt--;
+			return true;
+		}
 	}
+	return false;
+}
 
-	return NULL;
+/* Put CACHE newly installed in SHARD into replacement lists.
+	 With 2Q, only a sector found in ghost ring goes to hot list. */
+static void 
+insert_entry(struct cache_shard* shard, struct cache* cache)
+{
+	cache->hot = policy == CACHE_CLOCK || ghost_remove(shard, cache->sector);
+	list_push_back(cache->hot ? &shard->clock : &shard->probation, &cache->elem);
 }
 
-/* Write-Behind Policy */
-/* Remove buffer cache header, with writing back
-	 Executed when file is closed */
-void 
-cache_delete(block_sector_t sector)
+/* Remove CACHE of SHARD chosen by evict_cache() */
+static void 
+evict_entry(struct cache_shard* shard, struct cache* cache)
 {
-	struct cache* cache;
+	hash_delete(&shard->table, &cache->helem);
+	list_remove(&cache->elem);
+	disown(cache);
+	if(!cache->hot)
+		ghost_push(shard, cache->sector);
+	shard->stats.evictions++;
+}
 
-	lock_acquire(&cache_lock);
-	cache = scan_cache(sector);
-	if(cache == NULL)
-		goto done;
+/* Look up SECTOR in the index of SHARD
+	 Return cache struct if sector is in cache, NULL otherwise */
+static struct cache* 
+scan_cache(struct cache_shard* shard, block_sector_t sector)
+{
+	struct cache key;
+	struct hash_elem* e;
 
-	/* Reset cache bitmap as empty */
+	ASSERT(lock_held_by_current_thread(&shard->lock));
+
+	key.sector = sector;
+	e = hash_find(&shard->table, &key.helem);
+	return e != NULL ? hash_entry(e, struct cache, helem) : NULL;
+}
+
+/* Returns a hash value for cache entry E. */
+static unsigned 
+cache_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+	const struct cache* cache = hash_entry(e, struct cache, helem);
+	return hash_int(cache->sector);
+}
+
+/* Returns true if cache entry A caches a lower sector than B. */
+static bool 
+cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+	return hash_entry(a, struct cache, helem)->sector
+				 < hash_entry(b, struct cache, helem)->sector;
+}
+
+/* Give slot of CACHE back as empty space */
+static void 
+free_slot(struct cache* cache)
+{
+	lock_acquire(&slot_lock);
 	ASSERT(bitmap_test(cache_bmap, cache->bufpos));
 	bitmap_reset(cache_bmap, cache->bufpos);
+	lock_release(&slot_lock);
+}
+
+/* Zero-Copy Access */
+/* Pin SECTOR in buffer cache and store its entry in *CACHEP.
+	 Returns address of sector data, which stays in place until
+	 cache_unpin(). Hold lock of the entry while looking at data
+	 that may be written concurrently. SECTOR is recorded as
+	 belonging to OWNER, if not null. */
+const void* 
+cache_pin(block_sector_t sector, struct cache** cachep, struct cache_owner* owner)
+{
+	struct cache* cache = cache_get(sector, FILL_READ, owner);
+
+	cache->ref = true;
+	*cachep = cache;
+	return bufpos_to_addr(cache->bufpos);
+}
+
+/* Unpin CACHE pinned by cache_pin() */
+void 
+cache_unpin(struct cache* cache)
+{
+	cache_put(cache, false);
+}
+
+/* Write-Behind Policy */
+/* Forget CACHE being removed from buffer cache in its owner */
+static void 
+disown(struct cache* cache)
+{
+	lock_acquire(&owner_lock);
+	if(cache->owner != NULL)
+	{
+		list_remove(&cache->owner_elem);
+		cache->owner = NULL;
+	}
+	lock_release(&owner_lock);
+}
+
+/* Remove SECTOR from buffer cache, writing it back if WRITEBACK */
+static void 
+drop_sector(block_sector_t sector, bool writeback)
+{
+	struct cache_shard* shard = shard_of(sector);
+	struct cache* cache;
+
+	lock_acquire(&shard->lock);
+	while((cache = scan_cache(shard, sector)) != NULL
+				&& (cache->io || cache->pin_cnt > 0))
+		cond_wait(&shard->io_done, &shard->lock);
+	if(cache == NULL)
+	{
+		lock_release(&shard->lock);
+		return;
+	}
 
 	/* If cache is modified, write back to block */
-	lock_acquire(&cell_lock[cache->bufpos]);
 	if(cache->dirty)
-		block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
-	lock_release(&cell_lock[cache->bufpos]);
+	{
+		if(writeback)
+			writeback_victim(shard, cache);
+		else
+		{
+			cache->dirty = false;
+			shard->dirty_cnt--;
+		}
+	}
 
 	/* Remove cache metadata */
+	hash_delete(&shard->table, &cache->helem);
 	list_remove(&cache->elem);
-	free(cache);
+	disown(cache);
+	lock_release(&shard->lock);
 
-	done:
-		lock_release(&cache_lock);
+	/* Reset cache bitmap as empty */
+	free_slot(cache);
+}
+
+/* Remove buffer cache header, with writing back */
+void 
+cache_delete(block_sector_t sector)
+{
+	drop_sector(sector, true);
 }
 
-/* Flush entire buffer cache into filesys disk 
+/* Remove buffer cache header without writing back.
+	 Executed when SECTOR is freed, so no stale copy outlives it. */
+void 
+cache_discard(block_sector_t sector)
+{
+	drop_sector(sector, false);
+}
+
+/* Orders sector numbers. */
+static int 
+block_sector_compare(const void* a_, const void* b_)
+{
+	const block_sector_t* a = a_;
+	const block_sector_t* b = b_;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+/* Write back SECTOR if it is dirty in buffer cache */
+static void 
+flush_sector(block_sector_t sector)
+{
+	struct cache_shard* shard = shard_of(sector);
+	struct cache* cache;
+
+	lock_acquire(&shard->lock);
+	while((cache = scan_cache(shard, sector)) != NULL
+				&& (cache->io || cache->pin_cnt > 0))
+		cond_wait(&shard->io_done, &shard->lock);
+	if(cache != NULL && cache->dirty)
+		writeback_victim(shard, cache);
+	lock_release(&shard->lock);
+}
+
+static size_t flush_batch(int64_t deadline);
+
+/* Write back dirty entries of OWNER in ascending sector order.
+	 Touches only entries of OWNER, not every sector of the file.
+	 If DETACH, OWNER forgets its entries, which stay cached. */
+void 
+cache_flush_owner(struct cache_owner* owner, bool detach)
+{
+	block_sector_t* sectors;
+	struct list_elem* e;
+	size_t cnt = 0;
+	size_t i;
+
+	lock_acquire(&owner_lock);
+	sectors = malloc((list_size(&owner->entries) + 1) * sizeof *sectors);
+	for(e = list_begin(&owner->entries); e != list_end(&owner->entries); )
+	{
+		struct cache* cache = list_entry(e, struct cache, owner_elem);
+
+		if(cache->dirty && sectors != NULL)
+			sectors[cnt++] = cache->sector;
+		if(detach)
+		{
+			e = list_remove(e);
+			cache->owner = NULL;
+		}
+		else
+			e = list_next(e);
+	}
+	lock_release(&owner_lock);
+
+	/* Out of memory, write back whole buffer cache instead */
+	if(sectors == NULL)
+	{
+		while(flush_batch(INT64_MAX) > 0)
+			continue;
+		return;
+	}
+
+	qsort(sectors, cnt, sizeof *sectors, block_sector_compare);
+	for(i = 0; i < cnt; i++)
+		flush_sector(sectors[i]);
+	free(sectors);
+}
+
+/* Flush entire buffer cache into filesys disk
 	 Write back buffer with dirty bit */
 void 
 cache_writeback(void)
 {
 	struct cache* cache;
-	
+	size_t i;
+
 	cache_runbit = false;
 
-	lock_acquire(&cache_lock);
-	while(!list_empty(&cache_list))
+	for(i = 0; i < CACHE_SHARDS; i++)
 	{
-		cache = list_entry(list_pop_front(&cache_list), struct cache, elem);
+		struct cache_shard* shard = &shards[i];
 
-		/* Reset cache bitmap as empty */
-		ASSERT(bitmap_test(cache_bmap, cache->bufpos));
-		bitmap_reset(cache_bmap, cache->bufpos);
+		lock_acquire(&shard->lock);
+		while(!list_empty(&shard->clock) || !list_empty(&shard->probation))
+		{
+			struct list* list = list_empty(&shard->clock) ? &shard->probation : &shard->clock;
+			cache = list_entry(list_front(list), struct cache, elem);
+			if(cache->io || cache->pin_cnt > 0)
+			{
+				cond_wait(&shard->io_done, &shard->lock);
+				continue;
+			}
 
-		/* If cache is modified, write back to block */
-		lock_acquire(&cell_lock[cache->bufpos]);
-		if(cache->dirty)
-			block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
-		lock_release(&cell_lock[cache->bufpos]);
+			/* If cache is modified, write back to block */
+			if(cache->dirty)
+			{
+				block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
+				shard->stats.writebacks++;
+				shard->dirty_cnt--;
+			}
+
+			/* Remove cache metadata */
+			list_remove(&cache->elem);
+			hash_delete(&shard->table, &cache->helem);
+			disown(cache);
+			free_slot(cache);
+		}
+		lock_release(&shard->lock);
+	}
+}
+
+/* Evict CACHE if nobody is using it, writing it back if dirty.
+	 Only try-locks its shard, returns false if CACHE is busy. */
+static bool 
+drop_entry(struct cache* cache)
+{
+	block_sector_t sector = cache->sector;
+	struct cache_shard* shard = shard_of(sector);
+
+	if(!lock_try_acquire(&shard->lock))
+		return false;
+
+	/* Entry may be in the middle of moving between shards */
+	if(scan_cache(shard, sector) != cache || cache->io || cache->pin_cnt > 0)
+	{
+		lock_release(&shard->lock);
+		return false;
+	}
+
+	if(cache->dirty)
+	{
+		block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
+		shard->stats.writebacks++;
+		shard->dirty_cnt--;
+	}
+	hash_delete(&shard->table, &cache->helem);
+	list_remove(&cache->elem);
+	disown(cache);
+	lock_release(&shard->lock);
+	return true;
+}
+
+/* Give one page of buffer cache taken from user pool back to palloc,
+	 writing back its dirty sectors. Called when user pool is under pressure.
+	 Never blocks: returns false if no page could be released right now. */
+bool 
+cache_shrink(void)
+{
+	size_t page, start, i;
+	bool success = true;
 
-		/* Remove cache metadata */
-		list_remove(&cache->elem);
-		free(cache);
+	if(!lock_try_acquire(&slot_lock))
+		return false;
+
+	/* Select last present page beyond base pages */
+	for(page = cache_size / SECTORS_PER_PAGE; page > base_pages; page--)
+		if(cache_pages[page - 1] != NULL)
+			break;
+	if(page == base_pages)
+	{
+		lock_release(&slot_lock);
+		return false;
+	}
+	page--;
+	start = page * SECTORS_PER_PAGE;
+
+	/* Drop every entry cached in the page,
+		 the page stays if any of them is in use */
+	for(i = 0; i < SECTORS_PER_PAGE && success; i++)
+		if(bitmap_test(cache_bmap, start + i))
+		{
+			success = drop_entry(&cache_entries[start + i]);
+			if(success)
+				bitmap_reset(cache_bmap, start + i);
+		}
+
+	/* Mark page absent and return it */
+	if(success)
+	{
+		bitmap_set_multiple(cache_bmap, start, SECTORS_PER_PAGE, true);
+		palloc_free_page(cache_pages[page]);
+		cache_pages[page] = NULL;
 	}
-	lock_release(&cache_lock);
+	lock_release(&slot_lock);
+	return success;
 }
 
-/* Flush cache content into file disk periodically. */
+/* Returns true if too much of buffer cache is dirty. */
+static bool 
+dirty_ratio_exceeded(void)
+{
+	size_t dirty = 0;
+	size_t i;
+
+	for(i = 0; i < CACHE_SHARDS; i++)
+		dirty += shards[i].dirty_cnt;
+	return dirty * 100 >= cache_size * CACHE_DIRTY_RATIO;
+}
+
+/* Orders cache entries by sector number. */
+static int 
+sector_compare(const void* a_, const void* b_)
+{
+	const struct cache* a = *(struct cache* const*)a_;
+	const struct cache* b = *(struct cache* const*)b_;
+
+	return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Mark up to CNT idle dirty entries of SHARD as in-flight and store
+	 them in SET. Only entries dirtied before DEADLINE are taken.
+	 Returns the number of entries stored. */
+static size_t 
+collect_dirty(struct cache_shard* shard, struct cache** set,
+							size_t cnt, int64_t deadline)
+{
+	struct hash_iterator it;
+	size_t n = 0;
+
+	lock_acquire(&shard->lock);
+	hash_first(&it, &shard->table);
+	while(n < cnt && hash_next(&it))
+	{
+		struct cache* cache = hash_entry(hash_cur(&it), struct cache, helem);
+		if(cache->dirty && !cache->io && cache->pin_cnt == 0
+			 && cache->dirty_time <= deadline)
+		{
+			cache->io = true;
+			set[n++] = cache;
+		}
+	}
+	lock_release(&shard->lock);
+	return n;
+}
+
+/* Write back a batch of entries dirtied before DEADLINE.
+	 Entries are written in ascending sector order, as an elevator
+	 sweep, without holding any shard lock. Entries being written
+	 are in-flight, so only their users wait meanwhile.
+	 Returns the number of entries written. */
+static size_t 
+flush_batch(int64_t deadline)
+{
+	struct cache* set[CACHE_FLUSH_BATCH];
+	int64_t start = timer_ticks();
+	size_t cnt = 0;
+	size_t i;
+
+	for(i = 0; i < CACHE_SHARDS && cnt < CACHE_FLUSH_BATCH; i++)
+		cnt += collect_dirty(&shards[i], set + cnt, CACHE_FLUSH_BATCH - cnt, deadline);
+	qsort(set, cnt, sizeof *set, sector_compare);
+
+	/* Runs of adjacent sectors go to the device back to back */
+	for(i = 0; i < cnt; i++)
+		block_write(fs_device, set[i]->sector, bufpos_to_addr(set[i]->bufpos));
+
+	for(i = 0; i < cnt; i++)
+	{
+		struct cache_shard* shard = shard_of(set[i]->sector);
+
+		lock_acquire(&shard->lock);
+		set[i]->dirty = false;
+		set[i]->io = false;
+		shard->dirty_cnt--;
+		shard->stats.writebacks++;
+		/* Batch as a whole is counted in shard of its first sector */
+		if(i == 0)
+		{
+			shard->stats.flushes++;
+			shard->stats.flush_ticks += timer_elapsed(start);
+		}
+		cond_broadcast(&shard->io_done, &shard->lock);
+		lock_release(&shard->lock);
+	}
+	return cnt;
+}
+
+/* Flush cache content into file disk in background.
+	 Every CACHE_FLUSH_INTERVAL ticks entries older than CACHE_DIRTY_AGE
+	 are written back. If dirty ratio exceeds CACHE_DIRTY_RATIO, every
+	 dirty entry is written back regardless of its age. */
 static void 
 flush_cache(void* aux UNUSED)
 {
-	struct cache* cache;
-	struct list_elem* e;
+	int64_t last_flush = timer_ticks();
 
 	cache_runbit = true;
 
 	while(cache_runbit)
 	{
-		lock_acquire(&cache_lock);
-		for(e = list_begin(&cache_list); e != list_end(&cache_list); 
-				e = list_next(e))
+		if(dirty_ratio_exceeded())
 		{
-			cache = list_entry(e, struct cache, elem);
-			lock_acquire(&cell_lock[cache->bufpos]);
-			if(cache->dirty)
-			{
-				block_write(fs_device, cache->sector, bufpos_to_addr(cache->bufpos));
-				cache->dirty = false;
-			}
-			lock_release(&cell_lock[cache->bufpos]);
+			while(dirty_ratio_exceeded() && flush_batch(INT64_MAX) > 0)
+				continue;
+		}
+		else if(timer_elapsed(last_flush) >= CACHE_FLUSH_INTERVAL)
+		{
+			int64_t deadline = timer_ticks() - CACHE_DIRTY_AGE;
+
+			/* Free map changes batched since last interval join in */
+			free_map_flush();
+			while(flush_batch(deadline) == CACHE_FLUSH_BATCH)
+				continue;
+			last_flush = timer_ticks();
 		}
-		lock_release(&cache_lock);
 
-		timer_sleep(CACHE_FLUSH_INTERVAL);
+		timer_sleep(CACHE_FLUSH_TICK);
 	}
 }
 
 /* Read-Ahead Policy */
-static void fetch_block(void* aux);
-
-/* Install SECTOR data into buffer cache */
+/* Queue SECTOR to be read into buffer cache by read-ahead thread.
+	 The request is dropped if the queue is full. */
 void 
 cache_install(block_sector_t sector)
 {
@@ -312,27 +1060,91 @@ cache_install(block_sector_t sector)
 		return;
 
 	lock_acquire(&ahead_lock);
-	if(ahead_sector != UINT32_MAX || sector != ahead_sector)
+	if(ahead_cnt < READ_AHEAD_QUEUE)
 	{
-		lock_release(&ahead_lock);
-		return;
+		ahead_queue[(ahead_head + ahead_cnt++) % READ_AHEAD_QUEUE] = sector;
+		cond_signal(&ahead_ready, &ahead_lock);
 	}
-	ahead_sector = sector;
+	else
+		ahead_dropped++;
 	lock_release(&ahead_lock);
+}
+
+/* Read queued sectors into buffer cache, in background of their users.
+	 Prefetched entries stay unreferenced until actually used. */
+static void 
+read_ahead(void* aux UNUSED)
+{
+	block_sector_t sector;
 
-	thread_create("read_aheader", PRI_DEFAULT, fetch_block, NULL);
+	while(true)
+	{
+		lock_acquire(&ahead_lock);
+		while(ahead_cnt == 0)
+			cond_wait(&ahead_ready, &ahead_lock);
+		sector = ahead_queue[ahead_head];
+		ahead_head = (ahead_head + 1) % READ_AHEAD_QUEUE;
+		ahead_cnt--;
+		lock_release(&ahead_lock);
+
+		cache_put(cache_get(sector, FILL_AHEAD, NULL), false);
+	}
 }
 
+/* Statistics */
+/* Add counters of SHARD to STATS */
 static void 
-fetch_block(void* aux UNUSED)
+add_stats(struct cache_stats* stats, const struct cache_shard* shard)
 {
-	lock_acquire(&ahead_lock);
-	lock_acquire(&cache_lock);
-	/* Get buffer cache metadata */
-	if(scan_cache(ahead_sector) == NULL)
-		allocate_cache(ahead_sector, UINT32_MAX);
-	lock_release(&cache_lock);
+	stats->hits += shard->stats.hits;
+	stats->misses += shard->stats.misses;
+	stats->overwrites += shard->stats.overwrites;
+	stats->evictions += shard->stats.evictions;
+	stats->writebacks += shard->stats.writebacks;
+	stats->ahead_reads += shard->stats.ahead_reads;
+	stats->ahead_hits += shard->stats.ahead_hits;
+	stats->flushes += shard->stats.flushes;
+	stats->flush_ticks += shard->stats.flush_ticks;
+}
 
-	ahead_sector = UINT32_MAX;
+/* Store a snapshot of buffer cache counters into STATS, summed
+	 over shards each under its lock, along with time it was taken */
+void 
+cache_get_stats(struct cache_stats* stats)
+{
+	size_t i;
+
+	memset(stats, 0, sizeof *stats);
+	for(i = 0; i < CACHE_SHARDS; i++)
+	{
+		lock_acquire(&shards[i].lock);
+		add_stats(stats, &shards[i]);
+		lock_release(&shards[i].lock);
+	}
+	lock_acquire(&ahead_lock);
+	stats->ahead_dropped = ahead_dropped;
 	lock_release(&ahead_lock);
+	stats->ticks = timer_ticks();
+}
+
+/* Prints buffer cache statistics. */
+void 
+cache_print_stats(void)
+{
+	struct cache_stats s;
+	size_t i;
+
+	/* Shutdown may come from a panic with a shard lock held, so
+		 counters are summed without locks */
+	memset(&s, 0, sizeof s);
+	for(i = 0; i < CACHE_SHARDS; i++)
+		add_stats(&s, &shards[i]);
+	s.ahead_dropped = ahead_dropped;
+	printf("Buffer cache: %llu hits, %llu misses, %llu overwrites, "
+				 "%llu evictions, %llu write-backs\n",
+				 s.hits, s.misses, s.overwrites, s.evictions, s.writebacks);
+	printf("Read-ahead: %llu reads, %llu used, %llu dropped\n",
+				 s.ahead_reads, s.ahead_hits, s.ahead_dropped);
+	printf("Cache flusher: %llu batches in %llu ticks\n",
+				 s.flushes, s.flush_ticks);
 }
@@ -2,26 +2,56 @@
 #define FILESYS_CACHE_H
 
 #include <list.h>
+#include <hash.h>
+#include <cache-stats.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "threads/synch.h"
+
+/* Entries of buffer cache holding sectors of one file */
+struct cache_owner
+{
+	struct list entries;	/* Entries linked by owner_elem */
+};
 
 struct cache
 {
 	block_sector_t sector;	/* Cached disk sector */
 	unsigned bufpos;		/* Cached position in buffer cache */
 	bool dirty;				/* Dirty bit */
+	int64_t dirty_time;		/* Tick when entry became dirty */
 	bool ref;				/* Reference bit */
+	bool io;				/* In-flight device I/O, users must wait */
+	bool ahead;				/* Read ahead, not used yet */
+	bool hot;				/* In hot list, always true with clock policy */
+	int pin_cnt;			/* Number of users holding the entry */
+	struct lock lock;		/* Serializes copies in and out of buffer */
 	struct list_elem elem;	/* List element */
+	struct hash_elem helem;	/* Hash element, keyed by SECTOR */
+	struct cache_owner* owner;		/* File owning SECTOR, if known */
+	struct list_elem owner_elem;	/* Element in owner's entries */
 };
 
+size_t cache_max_size(void);
+bool cache_set_size(size_t sectors);
+bool cache_set_policy(const char* name);
 void cache_init(void);
 
-void cache_read(block_sector_t sector, uint8_t* buffer, 
-								size_t size, off_t ofs, block_sector_t next_sector);
-void cache_write(block_sector_t sector, const uint8_t* buffer, 
-								 size_t size, off_t ofs, block_sector_t next_sector);
+void cache_owner_init(struct cache_owner* owner);
+void cache_read(block_sector_t sector, uint8_t* buffer, size_t size, off_t ofs,
+								struct cache_owner* owner);
+void cache_write(block_sector_t sector, const uint8_t* buffer,
+								 size_t size, off_t ofs, struct cache_owner* owner);
+const void* cache_pin(block_sector_t sector, struct cache** cachep,
+											struct cache_owner* owner);
+void cache_unpin(struct cache* cache);
 void cache_delete(block_sector_t sector);
+void cache_discard(block_sector_t sector);
+void cache_flush_owner(struct cache_owner* owner, bool detach);
 void cache_writeback(void);
 void cache_install(block_sector_t sector);
+bool cache_shrink(void);
+void cache_get_stats(struct cache_stats* stats);
+void cache_print_stats(void);
 
 #endif /* filesys/cache.h */
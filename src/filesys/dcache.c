@@ -0,0 +1,188 @@
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of names cached */
+#define DCACHE_MAX 1024
+
+/* Name NAME in directory PARENT, resolved to SECTOR */
+struct dentry
+{
+	block_sector_t parent;		/* Sector of directory holding NAME */
+	char name[NAME_MAX + 1];	/* Component name */
+	block_sector_t sector;		/* Inode sector, DCACHE_NEGATIVE if none */
+	bool isdir;								/* Directory or file? */
+	struct hash_elem helem;		/* Hash element, keyed by PARENT and NAME */
+	struct list_elem elem;		/* Element in LRU list */
+};
+
+static struct hash dentries;		/* Cached names */
+static struct list lru;					/* Cached names, least recently used first */
+static struct lock dcache_lock;
+static unsigned generation;			/* Bumped on every invalidation */
+
+static unsigned dentry_hash(const struct hash_elem* e, void* aux);
+static bool dentry_less(const struct hash_elem* a, const struct hash_elem* b,
+												void* aux);
+static struct dentry* find(block_sector_t parent, const char* name);
+static void drop(struct dentry* d);
+
+/* Initialize name cache */
+void 
+dcache_init(void)
+{
+	hash_init(&dentries, dentry_hash, dentry_less, NULL);
+	list_init(&lru);
+	lock_init(&dcache_lock);
+}
+
+/* Returns current generation, to be passed to dcache_insert() for a
+	 name looked up in its directory after this call */
+unsigned 
+dcache_generation(void)
+{
+	return generation;
+}
+
+/* Look NAME in directory PARENT up in name cache.
+	 Returns false on miss. On hit, stores inode sector into *SECTORP,
+	 DCACHE_NEGATIVE if NAME is known not to exist, and whether it is
+	 a directory into *ISDIRP. */
+bool 
+dcache_lookup(block_sector_t parent, const char* name,
+							block_sector_t* sectorp, bool* isdirp)
+{
+	struct dentry* d;
+
+	lock_acquire(&dcache_lock);
+	d = find(parent, name);
+	if(d != NULL)
+	{
+		*sectorp = d->sector;
+		*isdirp = d->isdir;
+		list_remove(&d->elem);
+		list_push_back(&lru, &d->elem);
+	}
+	lock_release(&dcache_lock);
+	return d != NULL;
+}
+
+/* Cache NAME in directory PARENT as SECTOR, DCACHE_NEGATIVE if it
+	 does not exist. Dropped if any name was invalidated since
+	 GEN, as the lookup may have raced with a change. */
+void 
+dcache_insert(block_sector_t parent, const char* name,
+							block_sector_t sector, bool isdir, unsigned gen)
+{
+	struct dentry* d;
+
+	if(strlen(name) > NAME_MAX)
+		return;
+
+	lock_acquire(&dcache_lock);
+	if(gen != generation || find(parent, name) != NULL)
+	{
+		lock_release(&dcache_lock);
+		return;
+	}
+
+	/* Reuse least recently used entry when full */
+	if(hash_size(&dentries) >= DCACHE_MAX)
+	{
+		d = list_entry(list_front(&lru), struct dentry, elem);
+		hash_delete(&dentries, &d->helem);
+		list_remove(&d->elem);
+	}
+	else
+		d = malloc(sizeof *d);
+
+	if(d != NULL)
+	{
+		d->parent = parent;
+		strlcpy(d->name, name, sizeof d->name);
+		d->sector = sector;
+		d->isdir = isdir;
+		hash_insert(&dentries, &d->helem);
+		list_push_back(&lru, &d->elem);
+	}
+	lock_release(&dcache_lock);
+}
+
+/* Forget NAME in directory PARENT, which is being added or removed */
+void 
+dcache_invalidate(block_sector_t parent, const char* name)
+{
+	struct dentry* d;
+
+	lock_acquire(&dcache_lock);
+	generation++;
+	d = find(parent, name);
+	if(d != NULL)
+		drop(d);
+	lock_release(&dcache_lock);
+}
+
+/* Forget every name in directory PARENT, which is being removed */
+void 
+dcache_purge(block_sector_t parent)
+{
+	struct list_elem* e;
+
+	lock_acquire(&dcache_lock);
+	generation++;
+	for(e = list_begin(&lru); e != list_end(&lru); )
+	{
+		struct dentry* d = list_entry(e, struct dentry, elem);
+		e = list_next(e);
+		if(d->parent == parent)
+			drop(d);
+	}
+	lock_release(&dcache_lock);
+}
+
+/* Returns entry of NAME in directory PARENT, a null pointer if none */
+static struct dentry* 
+find(block_sector_t parent, const char* name)
+{
+	struct dentry key;
+	struct hash_elem* e;
+
+	if(strlen(name) > NAME_MAX)
+		return NULL;
+	key.parent = parent;
+	strlcpy(key.name, name, sizeof key.name);
+	e = hash_find(&dentries, &key.helem);
+	return e != NULL ? hash_entry(e, struct dentry, helem) : NULL;
+}
+
+/* Remove D from name cache and free it */
+static void 
+drop(struct dentry* d)
+{
+	hash_delete(&dentries, &d->helem);
+	list_remove(&d->elem);
+	free(d);
+}
+
+static unsigned 
+dentry_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+	const struct dentry* d = hash_entry(e, struct dentry, helem);
+	return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+static bool 
+dentry_less(const struct hash_elem* a_, const struct hash_elem* b_,
+						void* aux UNUSED)
+{
+	const struct dentry* a = hash_entry(a_, struct dentry, helem);
+	const struct dentry* b = hash_entry(b_, struct dentry, helem);
+
+	if(a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp(a->name, b->name) < 0;
+}
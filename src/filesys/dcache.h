@@ -0,0 +1,20 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* Sector cached for a name known not to exist */
+#define DCACHE_NEGATIVE UINT32_MAX
+
+void dcache_init(void);
+unsigned dcache_generation(void);
+bool dcache_lookup(block_sector_t parent, const char* name,
+									 block_sector_t* sectorp, bool* isdirp);
+void dcache_insert(block_sector_t parent, const char* name,
+									 block_sector_t sector, bool isdir, unsigned generation);
+void dcache_invalidate(block_sector_t parent, const char* name);
+void dcache_purge(block_sector_t parent);
+
+#endif /* filesys/dcache.h */
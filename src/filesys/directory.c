@@ -9,6 +9,11 @@
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
+#include "threads/synch.h"
+#include "filesys/cache.h"
+#include "filesys/free-map.h"
+#include "filesys/dcache.h"
+#include <hash.h>
 /* Project4 E */
 
 /* A directory. */
@@ -17,6 +22,9 @@ struct dir
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
 		bool deny_write;										/* Not Used: SYnch with struct file */
+		/* Project4 S */
+		struct inode *index;								/* Hash index, opened on first use */
+		/* Project4 E */
   };
 
 /* A single directory entry. */
@@ -31,6 +39,37 @@ struct dir_entry
 		/* Project4 E */
   };
 
+/* Project4 S */
+/* Directories of this many entry slots get a hash index. */
+#define DIR_INDEX_MIN 64
+
+/* Smallest number of slots in a hash index. */
+#define INDEX_SLOTS_MIN 256
+
+/* Header of hash index of a directory, kept in a file of its own
+   and followed by SLOT_CNT slots.  A slot is 0 if empty,
+   SLOT_DELETED if its entry was removed, or else 1 plus the number
+   of an entry of the directory, counted from 0.  Free entries are
+   chained through their INODE_SECTOR from FREE_HEAD, also 1 plus
+   entry number. */
+struct dir_index
+  {
+    uint32_t slot_cnt;                  /* Number of slots. */
+    uint32_t used_cnt;                  /* Number of slots not empty. */
+    uint32_t free_head;                 /* First free entry, 0 if none. */
+  };
+
+#define SLOT_DELETED UINT32_MAX
+
+static struct inode *index_open (struct dir *);
+static bool index_lookup (struct dir *, struct inode *, const char *,
+                          struct dir_entry *, off_t *);
+static void index_create (struct dir *);
+static bool index_add (struct dir *, struct inode *, struct dir_entry *);
+static bool index_remove (struct dir *, struct inode *, struct dir_entry *,
+                          off_t);
+/* Project4 E */
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -82,6 +121,9 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
+			/* Project4 S */
+      inode_close (dir->index);
+			/* Project4 E */
       free (dir);
     }
 }
@@ -101,26 +143,83 @@ dir_get_inode (const struct dir *dir)
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
 static bool
-lookup (const struct dir *dir, const char *name,
+lookup (struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
-  size_t ofs;
-  
+	/* Project4 S */
+  off_t length = inode_length (dir->inode);
+  off_t sector_ofs;
+  off_t ofs = 0;
+  struct inode *index;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  /* Large directory looks NAME up through its hash index */
+  index = index_open (dir);
+  if (index != NULL)
+    return index_lookup (dir, index, name, ep, ofsp);
+
+  /* Look at entries in place in buffer cache, sector by sector.
+     An entry crossing sector boundary is copied out instead. */
+  for (sector_ofs = 0; sector_ofs < length; sector_ofs += BLOCK_SECTOR_SIZE)
+    {
+      off_t sector_end = sector_ofs + BLOCK_SECTOR_SIZE;
+      struct cache *cache;
+      const uint8_t *data = inode_pin (dir->inode, sector_ofs, &cache);
+      bool found = false;
+
+      if (data != NULL)
+        {
+          lock_acquire (&cache->lock);
+          for (; ofs + (off_t) sizeof e <= sector_end
+                 && ofs + (off_t) sizeof e <= length; ofs += sizeof e)
+            {
+              const struct dir_entry *p =
+                (const struct dir_entry *) (data + ofs - sector_ofs);
+              if (p->in_use && !strcmp (name, p->name))
+                {
+                  e = *p;
+                  found = true;
+                  break;
+                }
+            }
+          lock_release (&cache->lock);
+          cache_unpin (cache);
+        }
+      else
+        {
+          /* Inline data or unallocated sector, read entry by entry */
+          for (; ofs + (off_t) sizeof e <= sector_end
+                 && ofs + (off_t) sizeof e <= length; ofs += sizeof e)
+            if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+                && e.in_use && !strcmp (name, e.name))
+              {
+                found = true;
+                break;
+              }
+        }
+
+      if (!found && ofs < sector_end
+          && inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e)
+        {
+          found = e.in_use && !strcmp (name, e.name);
+          if (!found)
+            ofs += sizeof e;
+        }
+
+      if (found)
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          return true;
+        }
+    }
   return false;
+	/* Project4 E */
 }
 
 /* Searches DIR for a file with the given NAME
@@ -128,7 +227,7 @@ lookup (const struct dir *dir, const char *name,
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
-dir_lookup (const struct dir *dir, const char *name,
+dir_lookup (struct dir *dir, const char *name,
             struct inode **inode, bool* isdir) 
 {
   struct dir_entry e;
@@ -147,14 +246,31 @@ dir_lookup (const struct dir *dir, const char *name,
 		*inode = inode_reopen(dir_get_inode(dir));
 		*isdir = true;
 	}
-  else if (lookup (dir, name, &e, NULL))
+	else
 	{
-    *inode = inode_open (e.inode_sector);
-		*isdir = e.isdir;
+		block_sector_t sector = inode_get_inumber(dir->inode);
+		block_sector_t found;
+
+		/* Remember names looked up, and names found missing, so that
+			 next lookup of NAME does not scan DIR */
+		if(!dcache_lookup(sector, name, &found, isdir))
+		{
+			unsigned gen = dcache_generation();
+
+			inode_lock_dir(dir->inode);
+			if(lookup(dir, name, &e, NULL))
+			{
+				found = e.inode_sector;
+				*isdir = e.isdir;
+			}
+			else
+				found = DCACHE_NEGATIVE;
+			inode_unlock_dir(dir->inode);
+			dcache_insert(sector, name, found, found != DCACHE_NEGATIVE && *isdir, gen);
+		}
+		*inode = found != DCACHE_NEGATIVE ? inode_open(found) : NULL;
 	}
 	/* Project4 E */
-  else
-    *inode = NULL;
 
   return *inode != NULL;
 }
@@ -182,10 +298,28 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
 	/* Project4 E */
     return false;
 
+	/* Project4 S */
+	/* Entries and hash index change one adder or remover at a time */
+	inode_lock_dir (dir->inode);
+	/* Project4 E */
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+	/* Project4 S */
+  /* Large directory takes free slot from its hash index */
+  if (index_open (dir) != NULL)
+    {
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      e.isdir = isdir;
+      success = index_add (dir, dir->index, &e);
+      goto done;
+    }
+	/* Project4 E */
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -206,8 +340,17 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
 	e.isdir = isdir;
 	/* Project4 E */
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	/* Project4 S */
+  if (success && inode_length (dir->inode) / (off_t) sizeof e >= DIR_INDEX_MIN)
+    index_create (dir);
+	/* Project4 E */
 
  done:
+	/* Project4 S */
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
+	inode_unlock_dir (dir->inode);
+	/* Project4 E */
   return success;
 }
 
@@ -228,6 +371,7 @@ dir_remove (struct dir *dir, const char *name)
 	/* Reject root removal */
 	if(!strcmp(name, "/"))
 		return false;
+	inode_lock_dir (dir->inode);
 
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
@@ -239,30 +383,53 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
 	/* Project4 S */
-	/* Check validity of directory entry */
+	/* Check validity of directory entry: only empty one goes */
 	if(e.isdir)
 	{
-		struct dir* edir = dir_open(inode);
+		struct dir* edir = dir_open(inode_reopen(inode));
 		char temp[NAME_MAX + 1];
-		if(dir_readdir(edir, temp))
-		{
-			dir_close(edir);
-			return false;
-		}
+		bool empty = edir != NULL && !dir_readdir(edir, temp);
+
+		dir_close(edir);
+		if(!empty)
+			goto done;
 	}
 	/* Project4 E */
 
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+	/* Project4 S */
+  if (index_open (dir) != NULL)
+    {
+      if (!index_remove (dir, dir->index, &e, ofs))
+        goto done;
+    }
+  else if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
+	/* Project4 E */
 
   /* Remove inode. */
   inode_remove (inode);
+	/* Project4 S */
+	dcache_invalidate (inode_get_inumber (dir->inode), name);
+	if (e.isdir)
+		dcache_purge (inode_get_inumber (inode));
+	/* Remove hash index of directory along with it */
+	if (inode_get_dir_index (inode) != 0)
+	{
+		struct inode *index = inode_open (inode_get_dir_index (inode));
+		if (index != NULL)
+			inode_remove (index);
+		inode_close (index);
+	}
+	/* Project4 E */
   success = true;
 
  done:
   inode_close (inode);
+	/* Project4 S */
+	inode_unlock_dir (dir->inode);
+	/* Project4 E */
   return success;
 }
 
@@ -287,13 +454,92 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 }
 
 /* Project4 S */
+/* Reads up to CNT entries of DIR in use, from where last read left
+   off, into ENTRIES.  Entries are read a sector's worth at a time.
+   Returns number of entries read, 0 at end of directory. */
+size_t
+dir_readdir_batch (struct dir *dir, struct dirent *entries, size_t cnt)
+{
+  struct dir_entry chunk[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  size_t n = 0;
+
+  while (n < cnt)
+    {
+      off_t size = inode_read_at (dir->inode, chunk, sizeof chunk, dir->pos);
+      size_t i;
+
+      if (size < (off_t) sizeof *chunk)
+        break;
+      for (i = 0; i < size / sizeof *chunk && n < cnt; i++)
+        {
+          dir->pos += sizeof *chunk;
+          if (chunk[i].in_use)
+            {
+              entries[n].inumber = chunk[i].inode_sector;
+              entries[n].isdir = chunk[i].isdir;
+              strlcpy (entries[n].name, chunk[i].name, sizeof entries[n].name);
+              n++;
+            }
+        }
+    }
+  return n;
+}
+
+/* Resolve NAME in directory at SECTOR into *NEXTP and *ISDIRP,
+	 through name cache if possible.
+	 Returns false if there is no such name. */
+static bool 
+dir_step(block_sector_t sector, const char* name,
+				 block_sector_t* nextp, bool* isdirp)
+{
+	unsigned gen = dcache_generation();
+	struct dir* dir;
+	struct dir_entry e;
+	bool found = true;
+
+	if(dcache_lookup(sector, name, nextp, isdirp))
+		return *nextp != DCACHE_NEGATIVE;
+
+	dir = dir_open(inode_open(sector));
+	if(dir == NULL)
+		return false;
+
+	/* Parent of root is root itself */
+	if(!strcmp(name, ".."))
+	{
+		*nextp = sector == ROOT_DIR_SECTOR ? ROOT_DIR_SECTOR
+																			 : inode_get_parent(dir->inode);
+		*isdirp = true;
+	}
+	else
+	{
+		inode_lock_dir(dir->inode);
+		found = lookup(dir, name, &e, NULL);
+		inode_unlock_dir(dir->inode);
+		if(found)
+		{
+			*nextp = e.inode_sector;
+			*isdirp = e.isdir;
+		}
+	}
+	dir_close(dir);
+
+	dcache_insert(sector, name, found ? *nextp : DCACHE_NEGATIVE,
+								found && *isdirp, gen);
+	return found;
+}
+
 /* Change working directory according to given name
 	 Change *DIR to one-step before destination file or directory. 
-	 Save destination file or directory name into FILENAME */
+	 Save destination file or directory name into FILENAME.
+	 Intermediate directories are resolved by sector, through name
+	 cache, and only the last of them is opened. */
 bool 
 dir_chdir(struct dir** dir, const char* name, char* filename)
 {
 	struct dir* cur_dir = *dir;
+	block_sector_t sector;
+	bool moved = false;
 	char* name_cp; 
 	char* path; 
 	char* save_ptr = NULL;
@@ -304,27 +550,32 @@ dir_chdir(struct dir** dir, const char* name, char* filename)
 		return false;
 
 	/* Copy entire path */
-	name_cp = palloc_get_page(PAL_ZERO);
+	name_cp = malloc(strlen(name) + 1);
 	if(name_cp == NULL)
 		return false;
-	strlcpy(name_cp, name, PGSIZE);
+	strlcpy(name_cp, name, strlen(name) + 1);
 
-	/* Change current directory into root if path is absolute */
+	/* Start from root if path is absolute */
+	sector = inode_get_inumber(dir_get_inode(cur_dir));
 	if(name_cp[0] == '/')
 	{
-		dir_close(cur_dir);
-		cur_dir = dir_open_root();
+		sector = ROOT_DIR_SECTOR;
+		moved = true;
 	}
 
 	/* Set initial path */
 	path = strtok_r(name_cp, "/", &save_ptr);
-	if(strlen(path) > NAME_MAX)
+	if(path == NULL || strlen(path) > NAME_MAX)
+	{
+		free(name_cp);
 		return false;
+	}
 
 	/* Traverse along the path */
 	while(path)
 	{
-		struct dir_entry e;
+		block_sector_t next_sector;
+		bool isdir;
 		char* next = strtok_r(NULL, "/", &save_ptr);
 
 		/* Handle case when PATH is the one to be saved. */
@@ -339,34 +590,27 @@ dir_chdir(struct dir** dir, const char* name, char* filename)
 		if(strlen(next) > NAME_MAX)
 			break;
 
-		/* Handle commands: ./.. */
-		if(!strcmp(path, "."))
+		/* Verify directory PATH (Must exist), then advance */
+		if(strcmp(path, "."))
 		{
-			path = next;
-			continue;
+			if(!dir_step(sector, path, &next_sector, &isdir) || !isdir)
+				break;
+			sector = next_sector;
+			moved = true;
 		}
+		path = next;
+	}
 
-		if(!strcmp(path, ".."))
-		{
-			block_sector_t parent = inode_get_parent(dir_get_inode(cur_dir));
-			dir_close(cur_dir);
-			cur_dir = dir_open(inode_open(parent));
-			path = next;
-			continue;
-		}
-
-		/* Verify directory PATH (Must exist) */
-		if(!lookup(cur_dir, path, &e, NULL) || !e.in_use || !e.isdir)
-			break;
-
-		/* Advance */
+	/* Open directory reached */
+	if(success && moved)
+	{
 		dir_close(cur_dir);
-		cur_dir = dir_open(inode_open(e.inode_sector));
-		path = next;
+		cur_dir = dir_open(inode_open(sector));
+		success = cur_dir != NULL;
 	}
 
 	*dir = cur_dir;
-	palloc_free_page(name_cp);
+	free(name_cp);
 	return success;
 }
 
@@ -379,4 +623,280 @@ dir_open_cur(void)
 	else
 		return dir_reopen(cur->dir);
 }
+
+/* Hash Index */
+/* Returns hash index of DIR, or a null pointer if it has none.
+   An index dropped or replaced through another opener of DIR is
+   closed here. */
+static struct inode *
+index_open (struct dir *dir)
+{
+  block_sector_t sector = inode_get_dir_index (dir->inode);
+
+  if (dir->index != NULL && inode_get_inumber (dir->index) != sector)
+    {
+      inode_close (dir->index);
+      dir->index = NULL;
+    }
+  if (sector != 0 && dir->index == NULL)
+    dir->index = inode_open (sector);
+  return dir->index;
+}
+
+/* Drops hash index of DIR, left incomplete by a failed update.
+   DIR goes back to linear scans, which see every entry in use. */
+static void
+index_drop (struct dir *dir)
+{
+  struct inode *index = dir->index;
+
+  inode_set_dir_index (dir->inode, 0);
+  dir->index = NULL;
+  inode_remove (index);
+  inode_close (index);
+}
+
+/* Reads header of hash index INDEX into H */
+static bool
+read_header (struct inode *index, struct dir_index *h)
+{
+  return inode_read_at (index, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Writes H as header of hash index INDEX */
+static bool
+write_header (struct inode *index, const struct dir_index *h)
+{
+  return inode_write_at (index, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns slot I of hash index INDEX */
+static uint32_t
+read_slot (struct inode *index, uint32_t i)
+{
+  uint32_t slot = 0;
+  inode_read_at (index, &slot, sizeof slot, sizeof (struct dir_index) + i * sizeof slot);
+  return slot;
+}
+
+/* Stores SLOT as slot I of hash index INDEX */
+static bool
+write_slot (struct inode *index, uint32_t i, uint32_t slot)
+{
+  return inode_write_at (index, &slot, sizeof slot,
+                         sizeof (struct dir_index) + i * sizeof slot) == sizeof slot;
+}
+
+/* Searches DIR for NAME through its hash index INDEX, like lookup() */
+static bool
+index_lookup (struct dir *dir, struct inode *index, const char *name,
+              struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_index h;
+  uint32_t i, n;
+
+  if (!read_header (index, &h) || h.slot_cnt == 0)
+    return false;
+
+  i = hash_string (name) % h.slot_cnt;
+  for (n = 0; n < h.slot_cnt; n++, i = (i + 1) % h.slot_cnt)
+    {
+      uint32_t slot = read_slot (index, i);
+      struct dir_entry e;
+      off_t ofs;
+
+      if (slot == 0)
+        break;
+      if (slot == SLOT_DELETED)
+        continue;
+
+      ofs = (off_t) (slot - 1) * sizeof e;
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+          && e.in_use && !strcmp (name, e.name))
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Puts entry number N named NAME into a slot of hash index INDEX,
+   whose header H is updated but not written */
+static bool
+index_insert (struct inode *index, struct dir_index *h,
+              const char *name, uint32_t n)
+{
+  uint32_t i = hash_string (name) % h->slot_cnt;
+  uint32_t slot;
+
+  while ((slot = read_slot (index, i)) != 0 && slot != SLOT_DELETED)
+    i = (i + 1) % h->slot_cnt;
+  if (slot == 0)
+    h->used_cnt++;
+  return write_slot (index, i, n + 1);
+}
+
+/* Returns number of slots for a hash index of directory of
+   ENTRY_CNT entry slots, so that at most a quarter is used */
+static uint32_t
+index_size (off_t entry_cnt)
+{
+  uint32_t slot_cnt = INDEX_SLOTS_MIN;
+
+  while (slot_cnt < 4 * (uint32_t) entry_cnt)
+    slot_cnt *= 2;
+  return slot_cnt;
+}
+
+/* Fills hash index INDEX of DIR from scratch with SLOT_CNT slots,
+   chaining free entries of DIR together. */
+static bool
+index_build (struct dir *dir, struct inode *index, uint32_t slot_cnt)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  struct dir_index h;
+  struct dir_entry e;
+  off_t size = slot_cnt * sizeof (uint32_t);
+  off_t ofs;
+
+  h.slot_cnt = slot_cnt;
+  h.used_cnt = 0;
+  h.free_head = 0;
+
+  for (ofs = 0; ofs < size; ofs += sizeof zeros)
+    {
+      off_t chunk = size - ofs < (off_t) sizeof zeros ? size - ofs : (off_t) sizeof zeros;
+      if (inode_write_at (index, zeros, chunk, sizeof h + ofs) != chunk)
+        return false;
+    }
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    {
+      uint32_t n = ofs / sizeof e;
+
+      if (e.in_use)
+        {
+          if (!index_insert (index, &h, e.name, n))
+            return false;
+        }
+      else
+        {
+          e.inode_sector = h.free_head;
+          h.free_head = n + 1;
+          if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            return false;
+        }
+    }
+  return write_header (index, &h);
+}
+
+/* Gives DIR, grown large, a hash index.
+   DIR stays as it was if the index cannot be made. */
+static void
+index_create (struct dir *dir)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t sector;
+  struct inode *index;
+
+  if (!free_map_allocate (dir_sector, 1, &sector))
+    return;
+  if (!inode_create (sector, 0, dir_sector))
+    {
+      free_map_release (sector, 1);
+      return;
+    }
+  index = inode_open (sector);
+  if (index == NULL)
+    {
+      free_map_release (sector, 1);
+      return;
+    }
+  if (!index_build (dir, index, index_size (inode_length (dir->inode)
+                                            / sizeof (struct dir_entry))))
+    {
+      inode_remove (index);
+      inode_close (index);
+      return;
+    }
+  inode_set_dir_index (dir->inode, sector);
+  dir->index = index;
+}
+
+/* Writes entry E into a free slot of DIR, found through hash index
+   INDEX, and indexes it. */
+static bool
+index_add (struct dir *dir, struct inode *index, struct dir_entry *e)
+{
+  struct dir_index h;
+  struct dir_entry free_e;
+  uint32_t n;
+
+  if (!read_header (index, &h) || h.slot_cnt == 0)
+    return false;
+
+  /* Take first free entry, or else append */
+  if (h.free_head != 0)
+    {
+      n = h.free_head - 1;
+      if (inode_read_at (dir->inode, &free_e, sizeof free_e,
+                         (off_t) n * sizeof free_e) != sizeof free_e)
+        return false;
+      h.free_head = free_e.inode_sector;
+    }
+  else
+    n = inode_length (dir->inode) / sizeof *e;
+
+  if (inode_write_at (dir->inode, e, sizeof *e, (off_t) n * sizeof *e) != sizeof *e
+      || !index_insert (index, &h, e->name, n)
+      || !write_header (index, &h))
+    return false;
+
+  /* Rebuild larger once half of slots are taken */
+  if (h.used_cnt * 2 > h.slot_cnt
+      && !index_build (dir, index, index_size (inode_length (dir->inode) / sizeof *e)))
+    index_drop (dir);
+  return true;
+}
+
+/* Writes entry E of DIR, no longer in use, back at OFS chained to
+   free entries, then drops it from hash index INDEX.  The index is
+   left as it was if the entry cannot be written. */
+static bool
+index_remove (struct dir *dir, struct inode *index, struct dir_entry *e,
+              off_t ofs)
+{
+  struct dir_index h;
+  uint32_t n = ofs / sizeof *e;
+  uint32_t i, k;
+
+  if (!read_header (index, &h) || h.slot_cnt == 0)
+    return inode_write_at (dir->inode, e, sizeof *e, ofs) == sizeof *e;
+
+  e->inode_sector = h.free_head;
+  if (inode_write_at (dir->inode, e, sizeof *e, ofs) != sizeof *e)
+    return false;
+
+  i = hash_string (e->name) % h.slot_cnt;
+  for (k = 0; k < h.slot_cnt; k++, i = (i + 1) % h.slot_cnt)
+    {
+      uint32_t slot = read_slot (index, i);
+      if (slot == 0)
+        break;
+      if (slot == n + 1)
+        {
+          write_slot (index, i, SLOT_DELETED);
+          break;
+        }
+    }
+
+  h.free_head = n + 1;
+  write_header (index, &h);
+  return true;
+}
 /* Project4 E */
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include <dirent.h>
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -11,6 +12,13 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* Project4 S */
+/* Names handed to user programs must fit in their buffers. */
+#if NAME_MAX != READDIR_MAX_LEN
+#error NAME_MAX and READDIR_MAX_LEN of <dirent.h> differ
+#endif
+/* Project4 E */
+
 struct inode;
 
 /* Opening and closing directories. */
@@ -22,11 +30,12 @@ void dir_close (struct dir *);
 struct inode *dir_get_inode (const struct dir *);
 
 /* Reading and writing. */
-bool dir_lookup (const struct dir *, const char *name, struct inode **, bool* isdir);
+bool dir_lookup (struct dir *, const char *name, struct inode **, bool* isdir);
 bool dir_add (struct dir *, const char *name, 
 							block_sector_t inode_sector, bool isdir);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_batch (struct dir *, struct dirent *, size_t cnt);
 
 /* Project4 S */
 /* Per-process directory management */
@@ -2,6 +2,13 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+/* Project4 S */
+#include "devices/block.h"
+
+/* Bounds of read-ahead window, in sectors. */
+#define READ_AHEAD_MIN 1
+#define READ_AHEAD_MAX 32
+/* Project4 E */
 
 /* An open file. */
 struct file 
@@ -9,8 +16,17 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    /* Project4 S */
+    off_t ra_pos;               /* Position expected by sequential read. */
+    off_t ra_end;               /* End of range already read ahead. */
+    int ra_window;              /* Read-ahead window in sectors. */
+    /* Project4 E */
   };
 
+/* Project4 S */
+static void file_read_ahead (struct file *, off_t ofs, off_t size);
+/* Project4 E */
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +39,11 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      /* Project4 S */
+      file->ra_pos = 0;
+      file->ra_end = 0;
+      file->ra_window = READ_AHEAD_MIN;
+      /* Project4 E */
       return file;
     }
   else
@@ -69,9 +90,31 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  /* Project4 S */
+  file_read_ahead (file, file->pos, bytes_read);
+  /* Project4 E */
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Project4 S */
+/* Reads SIZE bytes from FILE into BUFFER using COPY, starting at
+   the file's current position.  Data is copied straight out of
+   buffer cache, see inode_read_to().
+   Returns the number of bytes actually read, or -1 if COPY failed.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_read_to (struct file *file, void *buffer, off_t size,
+              inode_copy_func *copy)
+{
+  off_t bytes_read = inode_read_to (file->inode, buffer, size, file->pos, copy);
+  if (bytes_read < 0)
+    return -1;
+  file_read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
+/* Project4 E */
 
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
@@ -166,3 +209,37 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Project4 S */
+/* Tracks sequential access on FILE, which just read SIZE bytes at
+   OFS.  The read-ahead window doubles while reads continue where
+   the previous one stopped and halves otherwise.  For sequential
+   reads, sectors within the window past the read are queued for
+   read-ahead, except those already queued. */
+static void
+file_read_ahead (struct file *file, off_t ofs, off_t size)
+{
+  bool sequential = ofs == file->ra_pos;
+  off_t start, end;
+
+  file->ra_pos = ofs + size;
+  if (!sequential)
+    {
+      file->ra_window /= 2;
+      if (file->ra_window < READ_AHEAD_MIN)
+        file->ra_window = READ_AHEAD_MIN;
+      file->ra_end = 0;
+      return;
+    }
+  if (file->ra_window < READ_AHEAD_MAX)
+    file->ra_window *= 2;
+
+  start = file->ra_pos > file->ra_end ? file->ra_pos : file->ra_end;
+  end = file->ra_pos + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (size > 0 && start < end)
+    {
+      inode_read_ahead (file->inode, start, end - start);
+      file->ra_end = end;
+    }
+}
+/* Project4 E */
@@ -2,6 +2,9 @@
 #define FILESYS_FILE_H
 
 #include "filesys/off_t.h"
+/* Project4 S */
+#include "filesys/inode.h"
+/* Project4 E */
 
 struct inode;
 
@@ -14,6 +17,9 @@ struct inode *file_get_inode (struct file *);
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
+/* Project4 S */
+off_t file_read_to (struct file *, void *, off_t, inode_copy_func *);
+/* Project4 E */
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 
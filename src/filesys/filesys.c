@@ -10,6 +10,7 @@
 #include <limits.h>
 #include "threads/malloc.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 /* Project4 E */
 
 /* Partition that contains the file system. */
@@ -31,6 +32,7 @@ filesys_init (bool format)
 
 	/* Project4 S */
 	cache_init();
+	dcache_init();
 	/* Project4 E */
 
   if (format) 
@@ -45,9 +47,10 @@ void
 filesys_done (void) 
 {
 	/* Project4 S */
+	inode_reap ();
+  free_map_close ();
 	cache_writeback();
 	/* Project4 E */
-  free_map_close ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -64,7 +67,9 @@ filesys_create (const char *name, off_t initial_size, bool isdir)
 	block_sector_t parent_sector = inode_get_inumber(dir_get_inode(dir));
   bool success = (dir != NULL
 									&& dir_chdir(&dir, name, filename)
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate (isdir ? free_map_spread ()
+                                        : inode_get_inumber (dir_get_inode (dir)),
+                                        1, &inode_sector)
                   && inode_create (inode_sector, initial_size, parent_sector)
                   && dir_add (dir, filename, inode_sector, isdir));
   if (!success && inode_sector != 0) 
@@ -8,12 +8,162 @@
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
+#include <round.h>
 /* Project4 E */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 /* Project4 S */
 static struct lock free_map_lock;
+static struct bitmap *dirty_map;     /* Free map file sectors changed. */
+
+/* Number of free map bits in a sector of free map file. */
+#define SECTOR_BITS (BLOCK_SECTOR_SIZE * 8)
+
+/* Allocation groups, the disk divided into runs of GROUP_SECTORS.
+   Searches start near the requested sector, in its group, and skip
+   groups with nothing free, so that their cost does not depend on
+   how full the disk is. */
+#define GROUP_SECTORS 512
+static size_t group_cnt;             /* Number of groups. */
+static size_t *group_free;           /* Free sectors in each group. */
+static block_sector_t *group_hint;   /* Where to search each group from. */
+
+/* Marks free map file sectors holding bits of CNT sectors
+   from SECTOR to be written. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / SECTOR_BITS;
+  size_t last = (sector + cnt - 1) / SECTOR_BITS;
+
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Returns group of SECTOR. */
+static size_t
+group_of (block_sector_t sector)
+{
+  return sector / GROUP_SECTORS;
+}
+
+/* Returns sector past the end of group G. */
+static block_sector_t
+group_end (size_t g)
+{
+  size_t end = (g + 1) * GROUP_SECTORS;
+  return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
+}
+
+/* Recounts free sectors of every group from the free map. */
+static void
+count_groups (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      group_free[g] = bitmap_count (free_map, g * GROUP_SECTORS,
+                                    group_end (g) - g * GROUP_SECTORS, false);
+      group_hint[g] = g * GROUP_SECTORS;
+    }
+}
+
+/* Marks CNT sectors from START as USED or free, in free map and in
+   free counts of their groups. */
+static void
+set_sectors (block_sector_t start, size_t cnt, bool used)
+{
+  block_sector_t end = start + cnt;
+  block_sector_t s;
+
+  bitmap_set_multiple (free_map, start, cnt, used);
+  mark_dirty (start, cnt);
+  for (s = start; s < end; s = group_end (group_of (s)))
+    {
+      size_t g = group_of (s);
+      size_t n = (end < group_end (g) ? end : group_end (g)) - s;
+
+      if (used)
+        group_free[g] -= n;
+      else
+        {
+          group_free[g] += n;
+          if (s < group_hint[g])
+            group_hint[g] = s;
+        }
+    }
+  if (used)
+    group_hint[group_of (end - 1)] = end;
+}
+
+/* Searches group G for CNT free sectors in a row, from its hint
+   on and then from its start. If EXACT, only such a run will do,
+   otherwise the first free sector is taken if there is none.
+   Returns the first sector found, or BITMAP_ERROR. */
+static size_t
+scan_group (size_t g, size_t cnt, bool exact)
+{
+  block_sector_t lo = g * GROUP_SECTORS;
+  block_sector_t hi = group_end (g);
+  block_sector_t from = group_hint[g] >= lo && group_hint[g] < hi
+                        ? group_hint[g] : lo;
+  size_t first = BITMAP_ERROR;
+  int pass;
+
+  if (group_free[g] < (exact ? cnt : 1))
+    return BITMAP_ERROR;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      block_sector_t s = pass == 0 ? from : lo;
+      block_sector_t end = pass == 0 ? hi : from;
+
+      while (s < end)
+        {
+          size_t run = 0;
+
+          while (s + run < hi && run < cnt && !bitmap_test (free_map, s + run))
+            run++;
+          if (run == cnt)
+            return s;
+          if (run > 0 && first == BITMAP_ERROR)
+            first = s;
+          s += run + 1;
+        }
+    }
+  return exact ? BITMAP_ERROR : first;
+}
+
+/* Searches groups from that of GOAL on, wrapping around, for CNT
+   free sectors in a row, or for any free sector unless EXACT.
+   Returns the first sector found, or BITMAP_ERROR. */
+static size_t
+scan_groups (block_sector_t goal, size_t cnt, bool exact)
+{
+  size_t g0 = goal < bitmap_size (free_map) ? group_of (goal) : 0;
+  size_t i;
+
+  if (goal < bitmap_size (free_map) && !bitmap_test (free_map, goal)
+      && (!exact || (goal + cnt <= bitmap_size (free_map)
+                     && bitmap_none (free_map, goal, cnt))))
+    return goal;
+
+  /* Prefer a whole run anywhere to part of one nearby */
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t s = scan_group ((g0 + i) % group_cnt, cnt, true);
+      if (s != BITMAP_ERROR)
+        return s;
+    }
+  for (i = 0; !exact && i < group_cnt; i++)
+    {
+      size_t s = scan_group ((g0 + i) % group_cnt, cnt, false);
+      if (s != BITMAP_ERROR)
+        return s;
+    }
+  return BITMAP_ERROR;
+}
 /* Project4 E */
 
 /* Initializes the free map. */
@@ -27,41 +177,139 @@ free_map_init (void)
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 	/* Project4 S */
 	lock_init(&free_map_lock);
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                           BLOCK_SECTOR_SIZE));
+	group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+	group_free = calloc (group_cnt, sizeof *group_free);
+	group_hint = calloc (group_cnt, sizeof *group_hint);
+	if (dirty_map == NULL || group_free == NULL || group_hint == NULL)
+		PANIC ("bitmap creation failed--file system device is too large");
+	count_groups ();
 	/* Project4 E */
 }
 
 /* Project4 S */
-/* Allocates CNT consecutive sectors from the free map and stores 
-	 the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, as near
+	 GOAL as possible, and stores the first into *SECTORP.
 	 Returns true if successfil, false, if not enough consecutive 
-	 sectors were available or if the free_map file could not be 
-	 written. */
+	 sectors were available even after removed inodes still queued
+	 for reaper give their blocks back.
+	 The change reaches free_map file at next free_map_flush(). */
 bool 
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (block_sector_t goal, size_t cnt, block_sector_t *sectorp)
 {
-	lock_acquire(&free_map_lock);
-	block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write(free_map, free_map_file))
+	block_sector_t sector;
+
+	do
 	{
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+		lock_acquire(&free_map_lock);
+		sector = scan_groups (goal, cnt, true);
+		if (sector != BITMAP_ERROR)
+			set_sectors (sector, cnt, true);
+		lock_release(&free_map_lock);
 	}
-	lock_release(&free_map_lock);
+	while (sector == BITMAP_ERROR && inode_reap ());
 	if(sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates a run of 1 to CNT consecutive sectors from the free map,
+	 starting at HINT if it is free, or else at the run of CNT free
+	 sectors nearest to HINT, or else at the free sector nearest to
+	 HINT. Stores the first sector into *SECTORP.
+	 Returns the number of sectors allocated, 0 if the disk is full
+	 even after removed inodes queued for reaper are torn down.
+	 The change reaches free_map file at next free_map_flush(). */
+size_t
+free_map_allocate_run (block_sector_t hint, size_t cnt,
+											 block_sector_t *sectorp)
+{
+	size_t size = bitmap_size(free_map);
+	size_t start;
+	size_t n = 0;
+
+	ASSERT(cnt > 0);
+
+	do
+	{
+		lock_acquire(&free_map_lock);
+		start = scan_groups(hint, cnt, false);
+		if(start != BITMAP_ERROR)
+		{
+			while(n < cnt && start + n < size && !bitmap_test(free_map, start + n))
+				n++;
+			set_sectors(start, n, true);
+		}
+		lock_release(&free_map_lock);
+	}
+	while(n == 0 && inode_reap());
+	if(n > 0)
+		*sectorp = start;
+	return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
 	lock_acquire(&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  set_sectors (sector, cnt, false);
+	lock_release(&free_map_lock);
+}
+
+/* Returns a sector to allocate a new directory near: the start of
+	 the group with the most free sectors, so that directories and
+	 the files in them spread over the disk. */
+block_sector_t
+free_map_spread (void)
+{
+	size_t best = 0;
+	size_t g;
+
+	lock_acquire(&free_map_lock);
+	for (g = 1; g < group_cnt; g++)
+		if (group_free[g] > group_free[best])
+			best = g;
+	lock_release(&free_map_lock);
+	return best * GROUP_SECTORS;
+}
+
+/* Writes free map file sectors changed since last call into
+	 free map file, and so into buffer cache.
+	 Called periodically by buffer cache flusher. */
+void
+free_map_flush (void)
+{
+	size_t size;
+	size_t i;
+
+	if (free_map_file == NULL)
+		return;
+
+	lock_acquire(&free_map_lock);
+	size = bitmap_file_size (free_map);
+	for (i = 0; free_map_file != NULL && i < bitmap_size (dirty_map); i++)
+		if (bitmap_test (dirty_map, i))
+			{
+				size_t ofs = i * BLOCK_SECTOR_SIZE;
+				size_t chunk = size - ofs < BLOCK_SECTOR_SIZE ? size - ofs : BLOCK_SECTOR_SIZE;
+				if (bitmap_write_part (free_map, free_map_file, ofs, chunk))
+					bitmap_reset (dirty_map, i);
+			}
+	lock_release(&free_map_lock);
+}
+
+/* Writes free map to disk, so that every allocation so far
+	 survives a crash. */
+void
+free_map_sync (void)
+{
+	free_map_flush ();
+	lock_acquire(&free_map_lock);
+	if (free_map_file != NULL)
+		inode_sync (file_get_inode (free_map_file), false);
 	lock_release(&free_map_lock);
 }
 /* Project4 E */
@@ -75,13 +323,22 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+	/* Project4 S */
+  count_groups ();
+	/* Project4 E */
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+	/* Project4 S */
+  free_map_flush ();
+	lock_acquire(&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+	lock_release(&free_map_lock);
+	/* Project4 E */
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -101,4 +358,7 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+	/* Project4 S */
+  bitmap_set_all (dirty_map, false);
+	/* Project4 E */
 }
@@ -9,11 +9,21 @@
 /* Project4 S */
 #include "filesys/cache.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <hash.h>
 /* Project4 E */
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
+/* Project4 S */
+/* Identifies an inode mapping its data by extents. */
+#define INODE_EXTENT_MAGIC 0x494e4f45
+/* Identifies an inode holding its data in itself. */
+#define INODE_INLINE_MAGIC 0x494e4f49
+/* Project4 E */
 
 /* Project4 S */
 /* Max size of on-disk inode in sectors. */
@@ -29,10 +39,53 @@
 /* Error Identifier */
 #define EXTEND_ERROR UINT32_MAX
 
-/* On-disk inode (UNIX UFS).
+/* Number of in-memory block map segments, one per index block 
+   holding data sector numbers (single indirect, double indirect children) */
+#define MAP_SEGMENTS (1 + SECTOR_CAPACITY)
+
+/* Bounds of sectors reserved ahead of a growing file. */
+#define PREALLOC_MIN 8
+#define PREALLOC_MAX 64
+
+/* Number of extents in on-disk inode and in each extent block. */
+#define INODE_EXTENTS 36
+#define BLOCK_EXTENTS 42
+
+/* Max size of data held in on-disk inode, in place of its extents. */
+#define INODE_INLINE_MAX (INODE_EXTENTS * sizeof (struct extent))
+
+/* Run of LENGTH consecutive sectors from START,
+   holding consecutive file blocks from BLOCK. */
+struct extent
+  {
+    uint32_t block;                                 /* First file block. */
+    block_sector_t start;                           /* First sector. */
+    uint32_t length;                                /* Number of sectors. */
+  };
+
+/* Extent block, holding extents past those in on-disk inode.
+   Extent blocks are chained from EXTENT_TREE of on-disk inode.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    block_sector_t next;                            /* Next extent block. */
+    uint32_t unused;                                /* Not used. */
+    struct extent extents[BLOCK_EXTENTS];           /* Extents. */
+  };
+
+/* On-disk inode, in one of three formats told apart by MAGIC.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. 
-   The capacity of an single inode could be up to 8,460,288 byts long. 
-   (8,460,288 byts = INODE_MAX_SECTOR sectors ~= 8MB = 16,384 sectors = 8,388,608 bytes) */
+   With INODE_MAGIC (UNIX UFS), every sector is mapped through direct
+   and indirect sectors. The capacity of an single inode could be up
+   to 8,460,288 byts long. 
+   (8,460,288 byts = INODE_MAX_SECTOR sectors ~= 8MB = 16,384 sectors = 8,388,608 bytes)
+   With INODE_EXTENT_MAGIC, data is mapped by extents, the first
+   INODE_EXTENTS of them here and the rest in chained extent blocks.
+   Files are limited by disk size only.
+   With INODE_INLINE_MAGIC, up to INODE_INLINE_MAX bytes of data are
+   held in place of the extents, and no data sector is allocated.
+   New inodes take this format if small enough, or else the extent
+   format, and move into the extent format once they outgrow it. */
 struct inode_disk
   {
     off_t length;                                   /* File size in bytes. */
@@ -41,12 +94,22 @@ struct inode_disk
     block_sector_t single_indirect;                 /* Sector number of single indirect data. */
     block_sector_t double_indirect;                 /* Sector number of double indirect data. */
     unsigned magic;                                 /* Magic number. */
-    uint32_t unused[111];                           /* Not used. */
+    uint32_t extent_cnt;                            /* Number of extents. */
+    block_sector_t extent_tree;                     /* First extent block. */
+    union
+      {
+        struct extent extents[INODE_EXTENTS];       /* First extents. */
+        uint8_t inline_data[INODE_INLINE_MAX];      /* Inline data. */
+      };
+    block_sector_t dir_index;                       /* Directory hash index, 0 if none. */
   };
 
 static bool extend_inode(struct inode_disk* idisk, 
-												 block_sector_t* sectorp, block_sector_t isector, off_t pos);
+												 block_sector_t* sectorp, block_sector_t isector, off_t pos,
+												 struct cache_owner* owner);
 static block_sector_t get_sector(const struct inode_disk* idisk, off_t pos);
+static void close_index(const struct inode_disk* idisk, bool release);
+static bool inode_allocate(block_sector_t sector, off_t length);
 /* Project4 E */
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -60,36 +123,97 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+		/* Project4 S */
+    struct hash_elem helem;             /* Element in open inode table. */
+    struct list_elem reap_elem;         /* Element in list of inodes to reap. */
+		/* Project4 E */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 		/* Project4 S */
-		struct lock lock;										/* Inode usage synchronization */
+		bool loading;												/* Being read in by its first opener */
+		struct lock lock;										/* Open count and flags synchronization */
+		struct rwlock rwlock;								/* Data, length and block map */
+		struct lock map_lock;								/* Loading of block map segments */
+		struct lock dir_lock;								/* Entry changes of directory */
+		block_sector_t** map;								/* Block map segments, loaded lazily */
+		struct extent* extents;							/* Every extent, ordered by block */
+		size_t extent_cnt;									/* Number of EXTENTS */
+		block_sector_t* ext_blocks;					/* Extent blocks in chain order */
+		block_sector_t res_start;						/* First sector reserved for growth */
+		size_t res_cnt;											/* Number of sectors reserved */
+		uint32_t res_block;									/* File block RES_START is for */
+		size_t res_window;									/* Sectors to reserve next time */
+		struct cache_owner owner;						/* Data sectors in buffer cache */
 		/* Project4 E */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Project4 S */
+static block_sector_t map_sector(struct inode* inode, off_t pos);
+static void map_update(struct inode* inode, off_t pos, block_sector_t sector);
+static void map_free(struct inode* inode);
+static bool is_extent(const struct inode_disk* idisk);
+static bool is_inline(const struct inode_disk* idisk);
+static bool read_inline(struct inode* inode, void* buffer, off_t offset, off_t size);
+static bool promote_inline(struct inode* inode);
+static void write_inode(struct inode* inode);
+static bool load_extents(struct inode* inode);
+static block_sector_t extent_sector(const struct inode* inode, off_t pos);
+static bool extend_extent(struct inode* inode, off_t offset, off_t size,
+													bool overwrite, block_sector_t* sectorp);
+static void release_extents(struct inode* inode);
+static void release_reserve(struct inode* inode);
+static void release_index(struct inode* inode);
+static void teardown(struct inode* inode);
+static void reap_inodes(void* aux);
+/* Project4 E */
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return get_sector (&inode->data, pos);
+    return map_sector (inode, pos);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
 /* Project4 S */
+/* Open inodes by sector, so that opening a single inode twice
+   returns the same `struct inode'. */
+static struct hash open_inodes;
 static struct lock inodes_lock;
+static struct condition inodes_loaded;  /* Signaled when a load ends. */
+
+/* Removed inodes closed for the last time, whose blocks are given
+   back to free map by reaper thread, off the path of the closer. */
+static struct list reap_list;
+static struct lock reap_lock;
+static struct condition reap_ready;  /* Signaled when REAP_LIST grows. */
+static struct condition reap_idle;   /* Signaled when nothing is left. */
+static size_t reap_busy;             /* Inodes being reaped right now. */
+
+/* Returns hash of sector of inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, helem)->sector);
+}
+
+/* Orders inodes A and B by sector. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return hash_entry (a, struct inode, helem)->sector
+         < hash_entry (b, struct inode, helem)->sector;
+}
 /* Project4 E */
 
 /* Initializes the inode module. */
@@ -98,9 +222,15 @@ inode_init (void)
 {
   ASSERT (sizeof(struct inode_disk) == BLOCK_SECTOR_SIZE);
 
-  list_init (&open_inodes);
   /* Project4 S */
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
 	lock_init(&inodes_lock);
+	cond_init(&inodes_loaded);
+	list_init(&reap_list);
+	lock_init(&reap_lock);
+	cond_init(&reap_ready);
+	cond_init(&reap_idle);
+	thread_create("inode_reaper", PRI_DEFAULT, reap_inodes, NULL);
   /* Project4 E */
 }
 
@@ -126,24 +256,25 @@ inode_create (block_sector_t sector, off_t length, block_sector_t parent_sector)
   if (disk_inode != NULL)
     {
       /* Project4 S */
-			off_t i;
-			block_sector_t temp_str;
+			size_t i;
 
-      disk_inode->length = length;
       disk_inode->parent = parent_sector;
-      disk_inode->magic = INODE_MAGIC;
-
-      /* Attach each indirect sector to disk inode. */
+      disk_inode->magic = INODE_EXTENT_MAGIC;
+			if(length <= (off_t) INODE_INLINE_MAX)
+			{
+				/* Small inode holds its zeroed data in itself */
+				disk_inode->magic = INODE_INLINE_MAGIC;
+				disk_inode->length = length;
+			}
 			for(i = 0; i < DIRECT_LIMIT; i++)
 				disk_inode->direct_sectors[i] = EXTEND_ERROR;
       disk_inode->single_indirect = EXTEND_ERROR;
       disk_inode->double_indirect = EXTEND_ERROR;
+      disk_inode->extent_tree = EXTEND_ERROR;
 
-			for(i = 0; i < length; i += BLOCK_SECTOR_SIZE)
-				extend_inode(disk_inode, &temp_str, sector, i);
-
-			block_write(fs_device, sector, disk_inode);
-			success = true;
+			/* Write empty inode, then give it LENGTH bytes */
+			cache_write(sector, (const uint8_t*)disk_inode, BLOCK_SECTOR_SIZE, 0, NULL);
+			success = is_inline(disk_inode) || inode_allocate(sector, length);
 
 			/* Project4 E */
 			free (disk_inode);
@@ -151,43 +282,113 @@ inode_create (block_sector_t sector, off_t length, block_sector_t parent_sector)
   return success;
 }
 
+/* Project4 S */
+/* Allocate zeroed sectors for LENGTH bytes to empty inode SECTOR,
+	 in as few runs as free map allows. */
+static bool 
+inode_allocate(block_sector_t sector, off_t length)
+{
+	struct inode* inode = inode_open(sector);
+	block_sector_t data_sector;
+	bool success = inode != NULL;
+	off_t ofs;
+
+	if(!success)
+		return false;
+
+	rwlock_acquire_write(&inode->rwlock);
+	for(ofs = 0; success && ofs < length; ofs += BLOCK_SECTOR_SIZE)
+		if(map_sector(inode, ofs) == EXTEND_ERROR)
+			success = extend_extent(inode, ofs, length - ofs, false, &data_sector);
+	if(success)
+	{
+		inode->data.length = length;
+		write_inode(inode);
+	}
+	else
+		release_extents(inode);
+	rwlock_release_write(&inode->rwlock);
+
+	inode_close(inode);
+	return success;
+}
+/* Project4 E */
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
-
-  /* Check whether this inode is already open. */
 	/* Project4 S */
+	struct inode key;
+	struct hash_elem* e;
+
+  /* Check whether this inode is already open. 
+		 A removed inode is not to be opened again. An inode still being
+		 read in by another opener is waited for, then looked up anew,
+		 as it is gone if reading failed. */
+	key.sector = sector;
 	lock_acquire(&inodes_lock);
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-					lock_release(&inodes_lock);
-          return inode; 
-        }
-    }
+	while((e = hash_find(&open_inodes, &key.helem)) != NULL)
+	{
+		inode = hash_entry(e, struct inode, helem);
+		if(!inode->loading)
+		{
+			inode = inode_reopen(inode);
+			lock_release(&inodes_lock);
+			return inode;
+		}
+		cond_wait(&inodes_loaded, &inodes_lock);
+	}
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
+	{
+		lock_release(&inodes_lock);
     return NULL;
+	}
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, then publish as placeholder while reading it in
+		 without lock, so that opens of other inodes go on meanwhile. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+	inode->loading = true;
+	inode->map = NULL;
+	inode->extents = NULL;
+	inode->extent_cnt = 0;
+	inode->ext_blocks = NULL;
+	inode->res_cnt = 0;
+	inode->res_window = PREALLOC_MIN;
+	cache_owner_init(&inode->owner);
 	lock_init(&inode->lock);
+	rwlock_init(&inode->rwlock);
+	lock_init(&inode->map_lock);
+	lock_init(&inode->dir_lock);
+  hash_insert (&open_inodes, &inode->helem);
+	lock_release(&inodes_lock);
+
+	cache_read(inode->sector, (uint8_t*)&inode->data, BLOCK_SECTOR_SIZE, 0,
+						 &inode->owner);
+	if(is_extent(&inode->data) && !load_extents(inode))
+	{
+		lock_acquire(&inodes_lock);
+		hash_delete(&open_inodes, &inode->helem);
+		cond_broadcast(&inodes_loaded, &inodes_lock);
+		lock_release(&inodes_lock);
+		cache_flush_owner(&inode->owner, true);
+		map_free(inode);
+		free(inode);
+		return NULL;
+	}
+
+	lock_acquire(&inodes_lock);
+	inode->loading = false;
+	cond_broadcast(&inodes_loaded, &inodes_lock);
 	lock_release(&inodes_lock);
 	/* Project4 E */
   return inode;
@@ -227,7 +428,7 @@ void
 inode_close (struct inode *inode) 
 {
 	/* Project4 S */
-  off_t i;
+	bool last;
 	/* Project4 E */
 
   /* Ignore null pointer. */
@@ -235,52 +436,105 @@ inode_close (struct inode *inode)
     return;
 
 	/* Project4 S */
+	/* Drop from open inode table on last close, then tear INODE down
+		 with no lock held, so that opens of other inodes go on meanwhile.
+		 Opening INODE again reads it anew from buffer cache. */
 	lock_acquire(&inodes_lock);
-  /* Release resources if this was the last opener. */
 	lock_acquire(&inode->lock);
-  if (--inode->open_cnt == 0)
-    {
-			lock_release(&inode->lock);
-			/* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
-
-			/* Writeback and delete buffer cache */
-			for(i = 0; i < inode->data.length; i += BLOCK_SECTOR_SIZE)
-			{
-				block_sector_t sector = byte_to_sector(inode, i);
-				cache_delete(sector);
-			}
+	last = --inode->open_cnt == 0;
+	if(last)
+		hash_delete(&open_inodes, &inode->helem);
+	lock_release(&inode->lock);
+	lock_release(&inodes_lock);
 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-					/* Deallocate file blocks */
-          for (i = 0; i < inode->data.length; i += BLOCK_SECTOR_SIZE)
-            free_map_release (byte_to_sector(inode, i), 1);
-					/* Deallocate indirect inodes */
-					if(inode->data.double_indirect != EXTEND_ERROR)
-					{
-						block_sector_t* inode_d = malloc(BLOCK_SECTOR_SIZE);
-						block_read(fs_device, inode->data.double_indirect, inode_d);
-						for(i = 0; i < SECTOR_CAPACITY; i++)
-							if(inode_d[i] != EXTEND_ERROR)
-								free_map_release(inode_d[i], 1);
-						free_map_release(inode->data.double_indirect, 1);
-						free(inode_d);
-					}
-					if(inode->data.single_indirect != EXTEND_ERROR)
-						free_map_release(inode->data.single_indirect, 1);
-					/* Deallocate inode */
-          free_map_release (inode->sector, 1);
-        }
-      free (inode); 
+  /* Release resources if this was the last opener.
+     Removed inode is left to reaper thread. */
+  if (last && inode->removed)
+    {
+			lock_acquire(&reap_lock);
+			list_push_back(&reap_list, &inode->reap_elem);
+			cond_signal(&reap_ready, &reap_lock);
+			lock_release(&reap_lock);
     }
-	else
-		lock_release(&inode->lock);
-	lock_release(&inodes_lock);
+  else if (last)
+		teardown(inode);
 	/* Project4 E */
 }
 
+/* Project4 S */
+/* Release resources of INODE, closed by its last opener, and free it.
+	 Blocks of removed INODE go back to free map, a run at a time,
+	 and their cached copies are dropped unwritten. */
+static void 
+teardown(struct inode* inode)
+{
+	release_reserve(inode);
+	if(inode->removed && (is_extent(&inode->data) || is_inline(&inode->data)))
+	{
+		release_extents(inode);
+		cache_discard(inode->sector);
+		free_map_release(inode->sector, 1);
+	}
+	else if(inode->removed)
+		release_index(inode);
+	else
+	{
+		/* Write back inode and data sectors in buffer cache */
+		cache_flush_owner(&inode->owner, true);
+		if(!is_extent(&inode->data) && !is_inline(&inode->data))
+			close_index(&inode->data, false);
+	}
+	map_free(inode);
+	free(inode);
+}
+
+/* Reaper thread, tearing down removed inodes as they are queued */
+static void 
+reap_inodes(void* aux UNUSED)
+{
+	lock_acquire(&reap_lock);
+	for(;;)
+	{
+		struct inode* inode;
+
+		while(list_empty(&reap_list))
+			cond_wait(&reap_ready, &reap_lock);
+		inode = list_entry(list_pop_front(&reap_list), struct inode, reap_elem);
+		reap_busy++;
+		lock_release(&reap_lock);
+
+		teardown(inode);
+
+		lock_acquire(&reap_lock);
+		if(--reap_busy == 0 && list_empty(&reap_list))
+			cond_broadcast(&reap_idle, &reap_lock);
+	}
+}
+
+/* Tear down every removed inode queued for reaper thread, in the
+	 calling thread, and wait for those being reaped already.
+	 Returns true if there were any, so that their blocks are free now. */
+bool 
+inode_reap(void)
+{
+	bool pending;
+
+	lock_acquire(&reap_lock);
+	pending = !list_empty(&reap_list) || reap_busy > 0;
+	while(!list_empty(&reap_list))
+	{
+		struct inode* inode = list_entry(list_pop_front(&reap_list), struct inode, reap_elem);
+		lock_release(&reap_lock);
+		teardown(inode);
+		lock_acquire(&reap_lock);
+	}
+	while(reap_busy > 0)
+		cond_wait(&reap_idle, &reap_lock);
+	lock_release(&reap_lock);
+	return pending;
+}
+/* Project4 E */
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
@@ -302,16 +556,13 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
 
 	/* Project4 S */
-	lock_acquire(&inode->lock);
-  while (size > 0) 
+	rwlock_acquire_read(&inode->rwlock);
+  while (size > 0)  
     {
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-			/* Get sector number of next block */
-			block_sector_t next_sector = byte_to_sector(inode, offset + BLOCK_SECTOR_SIZE);
-
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
@@ -322,19 +573,23 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
+			/* Copy out of inode itself if inline */
+			if(sector_idx == EXTEND_ERROR && is_inline(&inode->data))
+				memcpy(buffer + bytes_read, inode->data.inline_data + offset, chunk_size);
 			/* Set zero for unallocated block before EOF */
-			if(sector_idx == EXTEND_ERROR)
+			else if(sector_idx == EXTEND_ERROR)
 				memset(buffer + bytes_read, 0, chunk_size);
 			/* Read sector with buffer cache */
 			else
-				cache_read(sector_idx, buffer + bytes_read, chunk_size, sector_ofs, next_sector);
+				cache_read(sector_idx, buffer + bytes_read, chunk_size, sector_ofs,
+									 &inode->owner);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-	lock_release(&inode->lock);
+	rwlock_release_read(&inode->rwlock);
 	/* Project4 E */
 
   return bytes_read;
@@ -351,19 +606,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
+	/* Project4 S */
+	bool exclusive;
+	/* Project4 E */
 
   if (inode->deny_write_cnt)
     return 0;
 
 	/* Project4 S */
-	lock_acquire(&inode->lock);
+	/* Writing within file changes no metadata and shares the lock with
+		 readers and other such writers. Growth, allocation and inline
+		 data take it exclusively. An inode never shrinks nor turns
+		 inline, so the choice holds once the lock is taken. */
+	exclusive = is_inline(&inode->data) || offset + size > inode_length(inode);
+	if(exclusive)
+		rwlock_acquire_write(&inode->rwlock);
+	else
+		rwlock_acquire_read(&inode->rwlock);
+	if(is_inline(&inode->data) && size > 0)
+	{
+		/* Write into inode itself while data fits in, 
+			 otherwise move data out to a data sector first */
+		if(offset + size <= (off_t) INODE_INLINE_MAX)
+		{
+			memcpy(inode->data.inline_data + offset, buffer, size);
+			if(offset + size > inode->data.length)
+				inode->data.length = offset + size;
+			write_inode(inode);
+			rwlock_release_write(&inode->rwlock);
+			return size;
+		}
+		if(!promote_inline(inode))
+			size = 0;
+	}
 	while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = get_sector (&inode->data, offset);
+      block_sector_t sector_idx = map_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-			/* Get sector number of next block */
-			block_sector_t next_sector = byte_to_sector(inode, offset + BLOCK_SECTOR_SIZE);
 
       /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
@@ -373,12 +653,32 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
       	break;
 
-			if(sector_idx == EXTEND_ERROR 
-				 && !extend_inode(&inode->data, &sector_idx, inode->sector, offset))
-				break;
+			/* Hole within file, to be allocated exclusively */
+			if(sector_idx == EXTEND_ERROR && !exclusive)
+			{
+				rwlock_release_read(&inode->rwlock);
+				rwlock_acquire_write(&inode->rwlock);
+				exclusive = true;
+				continue;
+			}
+
+			if(sector_idx == EXTEND_ERROR && is_extent(&inode->data))
+			{
+				/* Allocate run for the rest of the write at once */
+				if(!extend_extent(inode, offset, size, true, &sector_idx))
+					break;
+			}
+			else if(sector_idx == EXTEND_ERROR)
+			{
+				if(!extend_inode(&inode->data, &sector_idx, inode->sector, offset,
+												 &inode->owner))
+					break;
+				map_update(inode, offset, sector_idx);
+			}
 
 			/* Write into buffer cache */
-			cache_write(sector_idx, buffer + bytes_written, chunk_size, sector_ofs, next_sector);
+			cache_write(sector_idx, buffer + bytes_written, chunk_size, sector_ofs,
+									&inode->owner);
 
       /* Advance. */
       size -= chunk_size;
@@ -388,14 +688,135 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	if(offset > inode->data.length)
 	{
 		inode->data.length = offset;
-		block_write(fs_device, inode->sector, &inode->data);
+		write_inode(inode);
 	}
-	lock_release(&inode->lock);
+	if(exclusive)
+		rwlock_release_write(&inode->rwlock);
+	else
+		rwlock_release_read(&inode->rwlock);
 	/* Project4 E */
 
   return bytes_written;
 }
 
+/* Project4 S */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET,
+   using COPY straight out of buffer cache.  No lock is held while
+   COPY runs, so it may copy into pageable memory.
+   Returns the number of bytes actually read, or -1 if COPY failed. */
+off_t
+inode_read_to (struct inode *inode, void *buffer_, off_t size, off_t offset,
+               inode_copy_func *copy)
+{
+	static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+	uint8_t bounce[128];
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  while (size > 0)
+    {
+      struct cache *cache;
+      const void *src;
+      bool success;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - offset % BLOCK_SECTOR_SIZE;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually copy out of this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+			/* Inline data is copied out of inode under its lock,
+				 a bounce buffer at a time */
+			if(is_inline(&inode->data) && chunk_size > (int) sizeof bounce)
+				chunk_size = sizeof bounce;
+			if(is_inline(&inode->data) && read_inline(inode, bounce, offset, chunk_size))
+				success = copy(buffer + bytes_read, bounce, chunk_size);
+			else
+			{
+				/* Unallocated block before EOF reads as zero */
+				src = inode_pin(inode, offset, &cache);
+				if(src == NULL)
+					success = copy(buffer + bytes_read, zeros, chunk_size);
+				else
+				{
+					success = copy(buffer + bytes_read, src, chunk_size);
+					cache_unpin(cache);
+				}
+			}
+			if(!success)
+				return -1;
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  return bytes_read;
+}
+
+/* Pin sector holding byte OFFSET of INODE in buffer cache and store
+	 its entry in *CACHEP, to be released by cache_unpin().
+	 Returns address of the byte in buffer cache, valid up to end of
+	 its sector. Returns a null pointer if OFFSET is past end of file
+	 or its sector is not allocated, or if INODE holds data inline. */
+const void* 
+inode_pin(struct inode* inode, off_t offset, struct cache** cachep)
+{
+	block_sector_t sector = EXTEND_ERROR;
+	const uint8_t* data;
+
+	rwlock_acquire_read(&inode->rwlock);
+	if(offset < inode->data.length)
+		sector = map_sector(inode, offset);
+	rwlock_release_read(&inode->rwlock);
+	if(sector == EXTEND_ERROR)
+		return NULL;
+
+	data = cache_pin(sector, cachep, &inode->owner);
+	return data + offset % BLOCK_SECTOR_SIZE;
+}
+
+/* Write back dirty sectors of INODE in buffer cache, in ascending
+	 sector order, and return once they are on disk. Index blocks are
+	 written as they are needed to read the data back, and so is free
+	 map that records them allocated. The inode sector is among them
+	 only while dirty, that is after its length or block map changed,
+	 both needed to read the data back. Writes within file leave it
+	 clean, so fdatasync() then writes data alone; inodes keep no times,
+	 so DATA_ONLY has nothing more to skip. */
+void 
+inode_sync(struct inode* inode, bool data_only UNUSED)
+{
+	if(inode->sector != FREE_MAP_SECTOR)
+		free_map_sync();
+	cache_flush_owner(&inode->owner, false);
+}
+
+/* Queue sectors holding SIZE bytes of INODE from OFFSET for read-ahead.
+	 Unallocated sectors and sectors past end of file are skipped. */
+void 
+inode_read_ahead(struct inode* inode, off_t offset, off_t size)
+{
+	off_t end = offset + size;
+
+	rwlock_acquire_read(&inode->rwlock);
+	if(end > inode->data.length)
+		end = inode->data.length;
+	for(offset -= offset % BLOCK_SECTOR_SIZE; offset < end; offset += BLOCK_SECTOR_SIZE)
+	{
+		block_sector_t sector = map_sector(inode, offset);
+		if(sector != EXTEND_ERROR)
+			cache_install(sector);
+	}
+	rwlock_release_read(&inode->rwlock);
+}
+/* Project4 E */
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -438,11 +859,113 @@ inode_get_parent(const struct inode* inode)
 	return inode->data.parent;
 }
 
+/* Returns sector of hash index of directory INODE, 0 if none */
+block_sector_t 
+inode_get_dir_index(const struct inode* inode)
+{
+	return inode->data.dir_index;
+}
+
+/* Record SECTOR as hash index of directory INODE */
+void 
+inode_set_dir_index(struct inode* inode, block_sector_t sector)
+{
+	rwlock_acquire_write(&inode->rwlock);
+	inode->data.dir_index = sector;
+	write_inode(inode);
+	rwlock_release_write(&inode->rwlock);
+}
+
+/* Lock directory INODE against changes of its entries and hash
+	 index by others */
+void 
+inode_lock_dir(struct inode* inode)
+{
+	lock_acquire(&inode->dir_lock);
+}
+
+/* Release lock taken by inode_lock_dir() */
+void 
+inode_unlock_dir(struct inode* inode)
+{
+	lock_release(&inode->dir_lock);
+}
+
+/* Read INDEX-th sector number stored in index block SECTOR */
+static block_sector_t 
+read_index(block_sector_t sector, size_t index)
+{
+	struct cache* cache;
+	const block_sector_t* entries = cache_pin(sector, &cache, NULL);
+	block_sector_t entry = entries[index];
+
+	cache_unpin(cache);
+	return entry;
+}
+
+/* Store ENTRY as INDEX-th sector number of index block SECTOR */
+static void 
+write_index(block_sector_t sector, size_t index, block_sector_t entry,
+						struct cache_owner* owner)
+{
+	cache_write(sector, (const uint8_t*)&entry, sizeof entry, index * sizeof entry,
+							owner);
+}
+
+/* Initialize index block SECTOR with no sector attached */
+static void 
+clear_index(block_sector_t sector, struct cache_owner* owner)
+{
+	static block_sector_t empty[SECTOR_CAPACITY];
+
+	if(empty[0] != EXTEND_ERROR)
+		memset(empty, 0xff, BLOCK_SECTOR_SIZE);
+	cache_write(sector, (const uint8_t*)empty, BLOCK_SECTOR_SIZE, 0, owner);
+}
+
+/* Drop index block SECTOR from buffer cache,
+	 writing it back unless it is released as well */
+static void 
+close_sector(block_sector_t sector, bool release)
+{
+	if(release)
+	{
+		cache_discard(sector);
+		free_map_release(sector, 1);
+	}
+	else
+		cache_delete(sector);
+}
+
+/* Write back index blocks of IDISK and drop them from buffer cache.
+	 If RELEASE, give the index blocks back to free map as well. */
+static void 
+close_index(const struct inode_disk* idisk, bool release)
+{
+	size_t i;
+
+	if(idisk->double_indirect != EXTEND_ERROR)
+	{
+		for(i = 0; i < SECTOR_CAPACITY; i++)
+		{
+			block_sector_t indir_s = read_index(idisk->double_indirect, i);
+			if(indir_s == EXTEND_ERROR)
+				continue;
+			close_sector(indir_s, release);
+		}
+		close_sector(idisk->double_indirect, release);
+	}
+	if(idisk->single_indirect != EXTEND_ERROR)
+		close_sector(idisk->single_indirect, release);
+}
+
 /* Add index into inode as active section
-	 Return allocated sector */
+	 Return allocated sector. Index blocks and the new sector
+	 are recorded in buffer cache as belonging to OWNER. */
 static bool 
 extend_inode(struct inode_disk* idisk, 
-						 block_sector_t* sectorp, block_sector_t isector, off_t pos)
+						 block_sector_t* sectorp, block_sector_t isector, off_t pos,
+						 struct cache_owner* owner)
 {
 	off_t index = pos / BLOCK_SECTOR_SIZE;
 	block_sector_t sector = EXTEND_ERROR;
@@ -451,10 +974,12 @@ extend_inode(struct inode_disk* idisk,
 
 	ASSERT(isector != EXTEND_ERROR);
 
+	if(index >= INODE_MAX_SECTOR)
+		return false;
 	if(index < DIRECT_LIMIT)
 	{
 		ASSERT(idisk->direct_sectors[index] == EXTEND_ERROR);
-		if(free_map_allocate(1, &sector))
+		if(free_map_allocate(isector, 1, &sector))
 		{
 			idisk->direct_sectors[index] = sector;
 			success = true;
@@ -464,76 +989,173 @@ extend_inode(struct inode_disk* idisk,
 	{
 		size_t idx_single = index - DIRECT_LIMIT;
 		/* Set single indirect inode */
-		block_sector_t* single = malloc(BLOCK_SECTOR_SIZE);
 		if(idisk->single_indirect == EXTEND_ERROR)
 		{
-			if(!free_map_allocate(1, &idisk->single_indirect))
-				goto single_end;
-			memset(single, 0xff, BLOCK_SECTOR_SIZE);
+			if(!free_map_allocate(isector, 1, &idisk->single_indirect))
+				return false;
+			clear_index(idisk->single_indirect, owner);
 		}
-		else
-			block_read(fs_device, idisk->single_indirect, single);
 
 		/* Extend index */
-		ASSERT(single[idx_single] == EXTEND_ERROR);
-		if(free_map_allocate(1, &sector))
+		ASSERT(read_index(idisk->single_indirect, idx_single) == EXTEND_ERROR);
+		if(free_map_allocate(isector, 1, &sector))
 		{
-			single[idx_single] = sector;
-			block_write(fs_device, idisk->single_indirect, single);
+			write_index(idisk->single_indirect, idx_single, sector, owner);
 			success = true;
 		}
-		single_end:
-			free(single);
 	}
 	else
 	{
 		size_t idx_double = (index - SINGLE_INDIRECT_LIMIT) / SECTOR_CAPACITY;
 		size_t idx_single = (index - SINGLE_INDIRECT_LIMIT) % SECTOR_CAPACITY;
-		block_sector_t* indir_d = malloc(BLOCK_SECTOR_SIZE);
-		block_sector_t* indir_s = malloc(BLOCK_SECTOR_SIZE);
+		block_sector_t indir_s;
+
 		/* Access double indirect inode */
 		if(idisk->double_indirect == EXTEND_ERROR)
 		{
-			if(!free_map_allocate(1, &idisk->double_indirect))
-				goto double_end;
-			memset(indir_d, 0xff, BLOCK_SECTOR_SIZE);
+			if(!free_map_allocate(isector, 1, &idisk->double_indirect))
+				return false;
+			clear_index(idisk->double_indirect, owner);
 		}
-		else
-			block_read(fs_device, idisk->double_indirect, indir_d);
 
 		/* Access second-rank inode */
-		if(indir_d[idx_double] == EXTEND_ERROR)
+		indir_s = read_index(idisk->double_indirect, idx_double);
+		if(indir_s == EXTEND_ERROR)
 		{
-			if(!free_map_allocate(1, &indir_d[idx_double]))
-				goto double_end;
-			memset(indir_s, 0xff, BLOCK_SECTOR_SIZE);
+			if(!free_map_allocate(isector, 1, &indir_s))
+				return false;
+			clear_index(indir_s, owner);
+			write_index(idisk->double_indirect, idx_double, indir_s, owner);
 		}
-		else
-			block_read(fs_device, indir_d[idx_double], indir_s);
 
 		/* Extend index */
-		ASSERT(indir_s[idx_single] == EXTEND_ERROR);
-		if(free_map_allocate(1, &sector))
+		ASSERT(read_index(indir_s, idx_single) == EXTEND_ERROR);
+		if(free_map_allocate(isector, 1, &sector))
 		{
-			indir_s[idx_single] = sector;
-			block_write(fs_device, indir_d[idx_double], indir_s);
-			block_write(fs_device, idisk->double_indirect, indir_d);
+			write_index(indir_s, idx_single, sector, owner);
 			success = true;
 		}
-		double_end:
-			free(indir_s);
-			free(indir_d);
 	}
 	/* Free resource then return sector */
 	if(success)
 	{
-		block_write(fs_device, sector, zeros);
-		block_write(fs_device, isector, idisk);
+		/* Zero through buffer cache without reading old content,
+			 which also replaces a stale read-ahead copy */
+		cache_write(sector, (const uint8_t*)zeros, BLOCK_SECTOR_SIZE, 0, owner);
+		cache_write(isector, (const uint8_t*)idisk, BLOCK_SECTOR_SIZE, 0, owner);
 		*sectorp = sector;
 	}
 	return success;
 }
 
+/* Return block map segment SEG of INODE, a copy of the index block
+	 it stands for, loading it on first access. Readers sharing inode
+	 lock load segments one at a time under MAP_LOCK.
+	 Returns a null pointer if memory allocation fails. */
+static block_sector_t* 
+map_segment(struct inode* inode, size_t seg)
+{
+	block_sector_t* segment;
+	block_sector_t index_sector;
+
+	ASSERT(seg < MAP_SEGMENTS);
+
+	lock_acquire(&inode->map_lock);
+	if(inode->map == NULL)
+		inode->map = calloc(MAP_SEGMENTS, sizeof *inode->map);
+	if(inode->map == NULL || inode->map[seg] != NULL)
+	{
+		segment = inode->map != NULL ? inode->map[seg] : NULL;
+		lock_release(&inode->map_lock);
+		return segment;
+	}
+
+	segment = malloc(BLOCK_SECTOR_SIZE);
+	if(segment == NULL)
+	{
+		lock_release(&inode->map_lock);
+		return NULL;
+	}
+
+	/* Find index block, then copy it as a whole */
+	if(seg == 0)
+		index_sector = inode->data.single_indirect;
+	else if(inode->data.double_indirect == EXTEND_ERROR)
+		index_sector = EXTEND_ERROR;
+	else
+		index_sector = read_index(inode->data.double_indirect, seg - 1);
+
+	if(index_sector == EXTEND_ERROR)
+		memset(segment, 0xff, BLOCK_SECTOR_SIZE);
+	else
+		cache_read(index_sector, (uint8_t*)segment, BLOCK_SECTOR_SIZE, 0, NULL);
+
+	inode->map[seg] = segment;
+	lock_release(&inode->map_lock);
+	return segment;
+}
+
+/* Translate byte offset POS of INODE into sector through block map.
+	 Returns EXTEND_ERROR if no sector is allocated for POS. */
+static block_sector_t 
+map_sector(struct inode* inode, off_t pos)
+{
+	off_t index = pos / BLOCK_SECTOR_SIZE;
+	size_t seg;
+	block_sector_t* segment;
+
+	if(is_inline(&inode->data))
+		return EXTEND_ERROR;
+	if(is_extent(&inode->data))
+		return extent_sector(inode, pos);
+	if(index < DIRECT_LIMIT)
+		return inode->data.direct_sectors[index];
+
+	seg = (index - DIRECT_LIMIT) / SECTOR_CAPACITY;
+	if(seg >= MAP_SEGMENTS)
+		return EXTEND_ERROR;
+
+	segment = map_segment(inode, seg);
+	if(segment == NULL)
+		return get_sector(&inode->data, pos);
+	return segment[(index - DIRECT_LIMIT) % SECTOR_CAPACITY];
+}
+
+/* Record SECTOR, newly attached by extend_inode(), as data of 
+	 byte offset POS in block map of INODE */
+static void 
+map_update(struct inode* inode, off_t pos, block_sector_t sector)
+{
+	off_t index = pos / BLOCK_SECTOR_SIZE;
+	size_t seg;
+
+	if(index < DIRECT_LIMIT || inode->map == NULL)
+		return;
+
+	seg = (index - DIRECT_LIMIT) / SECTOR_CAPACITY;
+	if(inode->map[seg] != NULL)
+		inode->map[seg][(index - DIRECT_LIMIT) % SECTOR_CAPACITY] = sector;
+}
+
+/* Free block map and extents of INODE */
+static void 
+map_free(struct inode* inode)
+{
+	size_t i;
+
+	free(inode->extents);
+	free(inode->ext_blocks);
+	inode->extents = NULL;
+	inode->ext_blocks = NULL;
+	inode->extent_cnt = 0;
+	if(inode->map == NULL)
+		return;
+	for(i = 0; i < MAP_SEGMENTS; i++)
+		free(inode->map[i]);
+	free(inode->map);
+	inode->map = NULL;
+}
+
 static block_sector_t 
 get_sector(const struct inode_disk* idisk, off_t pos)
 {
@@ -543,41 +1165,470 @@ get_sector(const struct inode_disk* idisk, off_t pos)
 		return idisk->direct_sectors[index];
 	else if(index < SINGLE_INDIRECT_LIMIT)
 	{
-		block_sector_t sector;
-		block_sector_t* indir_s;
-		size_t idx_s = index - DIRECT_LIMIT;
-
 		if(idisk->single_indirect == EXTEND_ERROR)
 			return EXTEND_ERROR;
-
-		indir_s = malloc(BLOCK_SECTOR_SIZE);
-		block_read(fs_device, idisk->single_indirect, indir_s);
-		
-		sector = indir_s[idx_s];
-		free(indir_s);
-		return sector;
+		return read_index(idisk->single_indirect, index - DIRECT_LIMIT);
 	}
 	else
 	{
-		block_sector_t sector = EXTEND_ERROR;
 		size_t idx_s = (index - SINGLE_INDIRECT_LIMIT) % SECTOR_CAPACITY;
 		size_t idx_d = (index - SINGLE_INDIRECT_LIMIT) / SECTOR_CAPACITY;
-		block_sector_t* indir_s = malloc(BLOCK_SECTOR_SIZE);
-		block_sector_t* indir_d = malloc(BLOCK_SECTOR_SIZE);
+		block_sector_t indir_s;
 		
 		if(idisk->double_indirect == EXTEND_ERROR)
-			goto convert_done;
-		block_read(fs_device, idisk->double_indirect, indir_d);
-		
-		if(indir_d[idx_d] == EXTEND_ERROR)
-			goto convert_done;
-		block_read(fs_device, indir_d[idx_d], indir_s);
+			return EXTEND_ERROR;
+
+		indir_s = read_index(idisk->double_indirect, idx_d);
+		if(indir_s == EXTEND_ERROR)
+			return EXTEND_ERROR;
+		return read_index(indir_s, idx_s);
+	}
+}
+
+/* Extent Format */
+/* Returns true if IDISK maps its data by extents */
+static bool 
+is_extent(const struct inode_disk* idisk)
+{
+	return idisk->magic == INODE_EXTENT_MAGIC;
+}
+
+/* Number of extent blocks holding CNT extents */
+static size_t 
+extent_blocks(size_t cnt)
+{
+	return cnt > INODE_EXTENTS ? DIV_ROUND_UP(cnt - INODE_EXTENTS, BLOCK_EXTENTS) : 0;
+}
+
+/* Orders extents by file block. */
+static int 
+extent_compare(const void* a_, const void* b_)
+{
+	const struct extent* a = a_;
+	const struct extent* b = b_;
+
+	return a->block < b->block ? -1 : a->block > b->block;
+}
+
+/* Load every extent of INODE, in on-disk inode and extent blocks,
+	 ordered by file block for lookup.
+	 Returns false if memory allocation fails. */
+static bool 
+load_extents(struct inode* inode)
+{
+	size_t cnt = inode->data.extent_cnt;
+	size_t blocks = extent_blocks(cnt);
+	block_sector_t sector = inode->data.extent_tree;
+	size_t i;
+
+	if(cnt == 0)
+		return true;
+	inode->extents = malloc(cnt * sizeof *inode->extents);
+	if(inode->extents == NULL)
+		return false;
+	if(blocks > 0)
+	{
+		inode->ext_blocks = malloc(blocks * sizeof *inode->ext_blocks);
+		if(inode->ext_blocks == NULL)
+			return false;
+	}
+
+	memcpy(inode->extents, inode->data.extents,
+				 (cnt < INODE_EXTENTS ? cnt : INODE_EXTENTS) * sizeof *inode->extents);
+	for(i = 0; i < blocks; i++)
+	{
+		size_t first = INODE_EXTENTS + i * BLOCK_EXTENTS;
+		size_t n = cnt - first < BLOCK_EXTENTS ? cnt - first : BLOCK_EXTENTS;
+
+		inode->ext_blocks[i] = sector;
+		cache_read(sector, (uint8_t*)(inode->extents + first), n * sizeof *inode->extents,
+							 offsetof(struct extent_block, extents), &inode->owner);
+		cache_read(sector, (uint8_t*)&sector, sizeof sector,
+							 offsetof(struct extent_block, next), &inode->owner);
+	}
+	inode->extent_cnt = cnt;
+	qsort(inode->extents, cnt, sizeof *inode->extents, extent_compare);
+	return true;
+}
+
+/* Returns position of first extent of INODE past file BLOCK */
+static size_t 
+extent_after(const struct inode* inode, uint32_t block)
+{
+	size_t lo = 0, hi = inode->extent_cnt;
+
+	while(lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if(inode->extents[mid].block <= block)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Translate byte offset POS of INODE into sector through extents.
+	 Returns EXTEND_ERROR if no sector is allocated for POS. */
+static block_sector_t 
+extent_sector(const struct inode* inode, off_t pos)
+{
+	uint32_t block = pos / BLOCK_SECTOR_SIZE;
+	size_t i = extent_after(inode, block);
+	const struct extent* e;
+
+	if(i == 0)
+		return EXTEND_ERROR;
+	e = &inode->extents[i - 1];
+	if(block - e->block >= e->length)
+		return EXTEND_ERROR;
+	return e->start + (block - e->block);
+}
+
+/* Store extent E at position IDX of on-disk extents of INODE.
+	 On-disk inode is to be written by caller. */
+static void 
+store_extent(struct inode* inode, size_t idx, const struct extent* e)
+{
+	block_sector_t sector;
+
+	if(idx < INODE_EXTENTS)
+	{
+		inode->data.extents[idx] = *e;
+		return;
+	}
+	idx -= INODE_EXTENTS;
+	sector = inode->ext_blocks[idx / BLOCK_EXTENTS];
+	cache_write(sector, (const uint8_t*)e, sizeof *e,
+							offsetof(struct extent_block, extents) + idx % BLOCK_EXTENTS * sizeof *e,
+							&inode->owner);
+}
+
+/* Fetch extent at position IDX of on-disk extents of INODE into E */
+static void 
+fetch_extent(struct inode* inode, size_t idx, struct extent* e)
+{
+	block_sector_t sector;
+
+	if(idx < INODE_EXTENTS)
+	{
+		*e = inode->data.extents[idx];
+		return;
+	}
+	idx -= INODE_EXTENTS;
+	sector = inode->ext_blocks[idx / BLOCK_EXTENTS];
+	cache_read(sector, (uint8_t*)e, sizeof *e,
+						 offsetof(struct extent_block, extents) + idx % BLOCK_EXTENTS * sizeof *e,
+						 &inode->owner);
+}
+
+/* Record run of CNT sectors from START as file blocks from BLOCK
+	 of INODE, growing the last extent if the run continues it.
+	 Returns false if memory or disk allocation fails. */
+static bool 
+add_extent(struct inode* inode, uint32_t block, block_sector_t start, uint32_t cnt)
+{
+	size_t idx = inode->data.extent_cnt;
+	size_t pos = extent_after(inode, block);
+	struct extent e;
+	struct extent* extents;
+
+	/* Sequential append grows the last extent in place */
+	if(idx > 0)
+	{
+		fetch_extent(inode, idx - 1, &e);
+		if(e.block + e.length == block && e.start + e.length == start)
+		{
+			ASSERT(pos > 0 && inode->extents[pos - 1].block == e.block);
+			e.length += cnt;
+			inode->extents[pos - 1].length = e.length;
+			store_extent(inode, idx - 1, &e);
+			if(idx - 1 < INODE_EXTENTS)
+				write_inode(inode);
+			return true;
+		}
+	}
+
+	extents = realloc(inode->extents, (idx + 1) * sizeof *extents);
+	if(extents == NULL)
+		return false;
+	inode->extents = extents;
+
+	/* Chain new extent block when the last one is full */
+	if(extent_blocks(idx + 1) > extent_blocks(idx))
+	{
+		size_t blocks = extent_blocks(idx);
+		block_sector_t* ext_blocks;
+		block_sector_t sector;
+		static struct extent_block empty;
+
+		ext_blocks = realloc(inode->ext_blocks, (blocks + 1) * sizeof *ext_blocks);
+		if(ext_blocks == NULL)
+			return false;
+		inode->ext_blocks = ext_blocks;
+		if(!free_map_allocate(inode->sector, 1, &sector))
+			return false;
+
+		empty.next = EXTEND_ERROR;
+		cache_write(sector, (const uint8_t*)&empty, BLOCK_SECTOR_SIZE, 0, &inode->owner);
+		if(blocks == 0)
+			inode->data.extent_tree = sector;
+		else
+			cache_write(ext_blocks[blocks - 1], (const uint8_t*)&sector, sizeof sector,
+									offsetof(struct extent_block, next), &inode->owner);
+		ext_blocks[blocks] = sector;
+	}
+
+	e.block = block;
+	e.start = start;
+	e.length = cnt;
+	memmove(extents + pos + 1, extents + pos, (idx - pos) * sizeof *extents);
+	extents[pos] = e;
+	inode->extent_cnt++;
+	store_extent(inode, idx, &e);
+	inode->data.extent_cnt++;
+	write_inode(inode);
+	return true;
+}
+
+/* Allocate sectors for unmapped byte OFFSET of INODE and as many
+	 following blocks of SIZE bytes from OFFSET as free map gives in a
+	 run, without running into blocks already mapped. The run continues
+	 the sectors of the preceding block if possible. Sectors past those
+	 are reserved in INODE for the next blocks until close.
+	 New sectors are zeroed, except those the caller is about to
+	 overwrite as a whole if OVERWRITE.
+	 Stores sector of OFFSET into *SECTORP. */
+static bool 
+extend_extent(struct inode* inode, off_t offset, off_t size,
+							bool overwrite, block_sector_t* sectorp)
+{
+	static char zeros[BLOCK_SECTOR_SIZE];
+	uint32_t block = offset / BLOCK_SECTOR_SIZE;
+	size_t want = DIV_ROUND_UP(offset % BLOCK_SECTOR_SIZE + size, BLOCK_SECTOR_SIZE);
+	size_t pos = extent_after(inode, block);
+	block_sector_t hint = inode->sector + 1;
+	block_sector_t start;
+	size_t cnt;
+	size_t i;
+
+	ASSERT(extent_sector(inode, offset) == EXTEND_ERROR);
+
+	if(want == 0)
+		want = 1;
+	if(pos < inode->extent_cnt && inode->extents[pos].block - block < want)
+		want = inode->extents[pos].block - block;
+	if(pos > 0 && inode->extents[pos - 1].block + inode->extents[pos - 1].length == block)
+		hint = inode->extents[pos - 1].start + inode->extents[pos - 1].length;
+
+	/* Take sectors reserved for BLOCK, or reserve sectors
+		 past those wanted now, the more the longer the file grows */
+	if(inode->res_cnt == 0 || inode->res_block != block)
+	{
+		size_t ask;
+
+		/* Growth elsewhere than reserved starts over small */
+		if(inode->res_cnt > 0)
+			inode->res_window = PREALLOC_MIN;
+		ask = want < inode->res_window ? inode->res_window : want;
+		release_reserve(inode);
+		inode->res_cnt = free_map_allocate_run(hint, ask, &inode->res_start);
+		if(inode->res_cnt == 0)
+			return false;
+		inode->res_block = block;
+		if(inode->res_window < PREALLOC_MAX)
+			inode->res_window *= 2;
+	}
+	start = inode->res_start;
+	cnt = want < inode->res_cnt ? want : inode->res_cnt;
+	if(!add_extent(inode, block, start, cnt))
+		return false;
+	inode->res_start += cnt;
+	inode->res_cnt -= cnt;
+	inode->res_block += cnt;
+
+	/* Zero through buffer cache without reading old content */
+	for(i = 0; i < cnt; i++)
+	{
+		off_t ofs = (off_t)(block + i) * BLOCK_SECTOR_SIZE;
+		if(!overwrite || ofs < offset || ofs + BLOCK_SECTOR_SIZE > offset + size)
+			cache_write(start + i, (const uint8_t*)zeros, BLOCK_SECTOR_SIZE, 0,
+									&inode->owner);
+	}
+	*sectorp = start;
+	return true;
+}
+
+/* Give sectors reserved for growth of INODE back to free map */
+static void 
+release_reserve(struct inode* inode)
+{
+	if(inode->res_cnt > 0)
+		free_map_release(inode->res_start, inode->res_cnt);
+	inode->res_cnt = 0;
+}
+
+/* Write on-disk inode of INODE into buffer cache, where it stays
+	 dirty until written back along with its data */
+static void 
+write_inode(struct inode* inode)
+{
+	cache_write(inode->sector, (const uint8_t*)&inode->data, BLOCK_SECTOR_SIZE, 0,
+							&inode->owner);
+}
 
-		sector = indir_s[idx_s];
-		convert_done:
-			free(indir_s);
-			free(indir_d);
-			return sector;
+/* Inline Format */
+/* Returns true if IDISK holds its data in itself */
+static bool 
+is_inline(const struct inode_disk* idisk)
+{
+	return idisk->magic == INODE_INLINE_MAGIC;
+}
+
+/* Copy SIZE bytes of INODE from OFFSET into BUFFER if INODE holds
+	 its data inline. Returns false, copying nothing, if it does not. */
+static bool 
+read_inline(struct inode* inode, void* buffer, off_t offset, off_t size)
+{
+	bool success;
+
+	rwlock_acquire_read(&inode->rwlock);
+	success = is_inline(&inode->data);
+	if(success)
+		memcpy(buffer, inode->data.inline_data + offset, size);
+	rwlock_release_read(&inode->rwlock);
+	return success;
+}
+
+/* Move data of inline INODE into a data sector of its own, turning
+	 INODE into extent format. INODE stays as it was on failure. */
+static bool 
+promote_inline(struct inode* inode)
+{
+	off_t length = inode->data.length;
+	uint8_t* data = NULL;
+	block_sector_t sector;
+
+	ASSERT(is_inline(&inode->data));
+
+	if(length > 0)
+	{
+		data = malloc(length);
+		if(data == NULL)
+			return false;
+		memcpy(data, inode->data.inline_data, length);
+	}
+
+	inode->data.magic = INODE_EXTENT_MAGIC;
+	inode->data.extent_cnt = 0;
+	memset(inode->data.extents, 0, sizeof inode->data.extents);
+	if(length == 0)
+		write_inode(inode);
+	else if(extend_extent(inode, 0, length, false, &sector))
+		cache_write(sector, data, length, 0, &inode->owner);
+	else
+	{
+		inode->data.magic = INODE_INLINE_MAGIC;
+		memcpy(inode->data.inline_data, data, length);
+		free(data);
+		return false;
+	}
+	free(data);
+	return true;
+}
+
+/* Indexed Format Removal */
+/* Run of consecutive sectors being released, given back to free
+	 map at once when the next sector does not continue it */
+struct release_run
+{
+	block_sector_t start;		/* First sector */
+	size_t cnt;							/* Number of sectors, 0 if none */
+};
+
+/* Give sectors of RUN back to free map */
+static void 
+run_flush(struct release_run* run)
+{
+	if(run->cnt > 0)
+		free_map_release(run->start, run->cnt);
+	run->cnt = 0;
+}
+
+/* Add SECTOR, unless EXTEND_ERROR, to RUN, dropping its cached copy */
+static void 
+run_add(struct release_run* run, block_sector_t sector)
+{
+	if(sector == EXTEND_ERROR)
+		return;
+	cache_discard(sector);
+	if(run->cnt > 0 && run->start + run->cnt == sector)
+	{
+		run->cnt++;
+		return;
+	}
+	run_flush(run);
+	run->start = sector;
+	run->cnt = 1;
+}
+
+/* Add sectors mapped by index block SECTOR, through DEPTH levels of
+	 index blocks, and the index blocks themselves to RUN */
+static void 
+release_index_block(struct release_run* run, block_sector_t sector, int depth)
+{
+	struct cache* cache;
+	const block_sector_t* entries;
+	size_t i;
+
+	if(sector == EXTEND_ERROR)
+		return;
+	entries = cache_pin(sector, &cache, NULL);
+	for(i = 0; i < SECTOR_CAPACITY; i++)
+		if(depth > 1)
+			release_index_block(run, entries[i], depth - 1);
+		else
+			run_add(run, entries[i]);
+	cache_unpin(cache);
+	run_add(run, sector);
+}
+
+/* Give data sectors, index blocks and inode sector of removed indexed
+	 INODE back to free map, reading each index block once */
+static void 
+release_index(struct inode* inode)
+{
+	struct release_run run = { 0, 0 };
+	size_t i;
+
+	for(i = 0; i < DIRECT_LIMIT; i++)
+		run_add(&run, inode->data.direct_sectors[i]);
+	release_index_block(&run, inode->data.single_indirect, 1);
+	release_index_block(&run, inode->data.double_indirect, 2);
+	run_add(&run, inode->sector);
+	run_flush(&run);
+}
+
+/* Give data sectors and extent blocks of INODE back to free map,
+	 a run per extent, dropping their cached copies */
+static void 
+release_extents(struct inode* inode)
+{
+	size_t i;
+	uint32_t j;
+
+	for(i = 0; i < inode->extent_cnt; i++)
+	{
+		const struct extent* e = &inode->extents[i];
+		for(j = 0; j < e->length; j++)
+			cache_discard(e->start + j);
+		free_map_release(e->start, e->length);
+	}
+	for(i = 0; i < extent_blocks(inode->extent_cnt); i++)
+	{
+		cache_discard(inode->ext_blocks[i]);
+		free_map_release(inode->ext_blocks[i], 1);
 	}
+	inode->extent_cnt = 0;
 }
 /* Project4 E */
@@ -2,10 +2,17 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
+/* Project4 S */
+struct cache;
+
+/* Copies SIZE bytes from SRC to DST, returns false on failure. */
+typedef bool inode_copy_func (void *dst, const void *src, size_t size);
+/* Project4 E */
 
 void inode_init (void);
 /* Project4 S */
@@ -18,11 +25,23 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+/* Project4 S */
+off_t inode_read_to (struct inode *, void *, off_t size, off_t offset,
+                     inode_copy_func *);
+const void *inode_pin (struct inode *, off_t offset, struct cache **);
+void inode_read_ahead (struct inode *, off_t offset, off_t size);
+void inode_sync (struct inode *, bool data_only);
+/* Project4 E */
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 /* Project4 S */
 block_sector_t inode_get_parent(const struct inode*);
+block_sector_t inode_get_dir_index(const struct inode*);
+void inode_set_dir_index(struct inode*, block_sector_t);
+void inode_lock_dir(struct inode*);
+void inode_unlock_dir(struct inode*);
+bool inode_reap(void);
 /* Project4 E */
 
 #endif /* filesys/inode.h */
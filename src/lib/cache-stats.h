@@ -0,0 +1,20 @@
+#ifndef __LIB_CACHE_STATS_H
+#define __LIB_CACHE_STATS_H
+
+/* Buffer cache counters, reported at shutdown and by cache_stats(). */
+struct cache_stats
+  {
+    unsigned long long hits;            /* Lookups finding the sector. */
+    unsigned long long misses;          /* Lookups reading the sector. */
+    unsigned long long overwrites;      /* Misses installed without read. */
+    unsigned long long evictions;       /* Entries evicted for others. */
+    unsigned long long writebacks;      /* Dirty sectors written back. */
+    unsigned long long ahead_reads;     /* Sectors read ahead. */
+    unsigned long long ahead_hits;      /* Read-ahead sectors used later. */
+    unsigned long long ahead_dropped;   /* Read-ahead requests dropped. */
+    unsigned long long flushes;         /* Batches written by flusher. */
+    unsigned long long flush_ticks;     /* Timer ticks spent in batches. */
+    unsigned long long ticks;           /* Timer ticks since boot. */
+  };
+
+#endif /* lib/cache-stats.h */
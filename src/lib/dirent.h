@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum characters in a filename written by readdir() and
+   getdents().  Equals NAME_MAX of the file system, which
+   filesys/directory.h checks. */
+#define READDIR_MAX_LEN 14
+
+/* Directory entry, as filled in by getdents(). */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    bool isdir;                         /* Directory or file? */
+    char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -358,6 +358,18 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes SIZE bytes of B from byte OFS to the same place in FILE,
+   as bitmap_write() would.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  ASSERT (ofs + size <= byte_cnt (b->bit_cnt));
+  return (size_t) file_write_at (file, (const uint8_t *) b->bits + ofs,
+                                 size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
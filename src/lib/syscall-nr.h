@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_FSYNC,                  /* Write a file's data and metadata to disk. */
+    SYS_FDATASYNC,              /* Write a file's data to disk. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+
+    /* Buffer cache instrumentation. */
+    SYS_CACHE_STATS             /* Snapshot buffer cache counters. */
   };
 
 #endif /* lib/syscall-nr.h */
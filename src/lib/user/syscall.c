@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+int
+getdents (int fd, struct dirent *entries, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, cnt);
+}
+
+bool
+cache_stats (struct cache_stats *stats)
+{
+  return syscall1 (SYS_CACHE_STATS, stats);
+}
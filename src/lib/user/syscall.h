@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <cache-stats.h>
+#include <dirent.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,9 +14,6 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
-/* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
-
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -44,5 +43,11 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int fsync (int fd);
+int fdatasync (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt);
+
+/* Buffer cache instrumentation. */
+bool cache_stats (struct cache_stats *);
 
 #endif /* lib/user/syscall.h */
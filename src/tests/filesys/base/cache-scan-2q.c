@@ -0,0 +1,6 @@
+/* Streams a file past repeated path lookups, with the 2Q
+   replacement policy in the buffer cache, which must keep the
+   hot set cached while the stream passes. */
+
+#define SCAN_RESISTANT
+#include "tests/filesys/base/cache-scan.inc"
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Hits and misses of each hot set re-read are informational only.
+@output = grep (!/^\(cache-scan-2q\) scan: /, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cache-scan-2q) begin
+(cache-scan-2q) mkdir "a"
+(cache-scan-2q) mkdir "a/b"
+(cache-scan-2q) mkdir "a/b/c"
+(cache-scan-2q) created 8 files in "/a/b/c"
+(cache-scan-2q) create "stream"
+(cache-scan-2q) open "stream"
+(cache-scan-2q) stream 1024 sectors, reading hot set every 16 sectors
+(cache-scan-2q) stream 1024 sectors, reading hot set every 256 sectors
+(cache-scan-2q) hot set stayed cached during scan
+(cache-scan-2q) close "stream"
+(cache-scan-2q) end
+EOF
+pass;
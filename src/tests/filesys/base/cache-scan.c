@@ -0,0 +1,5 @@
+/* Streams a file past repeated path lookups, with the default
+   clock replacement policy in the buffer cache.  The hot set
+   may well be pushed out; its hits and misses are reported. */
+
+#include "tests/filesys/base/cache-scan.inc"
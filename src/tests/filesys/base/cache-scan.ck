@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Hits and misses of each hot set re-read are informational only.
+@output = grep (!/^\(cache-scan\) scan: /, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cache-scan) begin
+(cache-scan) mkdir "a"
+(cache-scan) mkdir "a/b"
+(cache-scan) mkdir "a/b/c"
+(cache-scan) created 8 files in "/a/b/c"
+(cache-scan) create "stream"
+(cache-scan) open "stream"
+(cache-scan) stream 1024 sectors, reading hot set every 16 sectors
+(cache-scan) stream 1024 sectors, reading hot set every 256 sectors
+(cache-scan) close "stream"
+(cache-scan) end
+EOF
+pass;
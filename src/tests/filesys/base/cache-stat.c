@@ -0,0 +1,45 @@
+/* Reads a file twice and checks that the buffer cache counters
+   returned by cache_stats() account for the second read as
+   cache hits. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 16
+
+static char buf[BLOCK_SIZE * BLOCK_CNT];
+
+void
+test_main (void) 
+{
+  const char *file_name = "stat";
+  struct cache_stats before, after;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  CHECK (cache_stats (&before), "snapshot cache counters");
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"%s\"", file_name);
+  CHECK (cache_stats (&after), "snapshot cache counters again");
+
+  if (after.hits - before.hits < BLOCK_CNT)
+    fail ("read of %d cached sectors counted %llu hits",
+          BLOCK_CNT, after.hits - before.hits);
+  if (after.misses != before.misses)
+    fail ("read of cached sectors counted %llu misses",
+          after.misses - before.misses);
+  msg ("counters account for cached read");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-stat) begin
+(cache-stat) create "stat"
+(cache-stat) open "stat"
+(cache-stat) write "stat"
+(cache-stat) snapshot cache counters
+(cache-stat) read "stat"
+(cache-stat) snapshot cache counters again
+(cache-stat) counters account for cached read
+(cache-stat) close "stat"
+(cache-stat) end
+EOF
+pass;
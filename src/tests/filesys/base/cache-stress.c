@@ -0,0 +1,111 @@
+/* Re-reads working sets of growing size from one file, up to
+   several times the 64 sectors of the original fixed-size buffer
+   cache, on a cache of 1,024 sectors.  After a warm-up pass each
+   working set must stay resident, so that cache_stats() counts
+   every re-read as a hit and none as a miss.
+
+   Every phase does the same number of reads, and reports the
+   timer ticks it took.  With a hashed cache index the cost of a
+   hit does not depend on how many sectors are resident, so the
+   ticks should stay about the same from phase to phase, where a
+   scan of the cache on each lookup made them grow with the
+   working set.  Ticks vary between runs and simulators, so
+   cache-stress.ck does not compare them. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define MAX_BLOCKS 512
+#define READ_CNT 4096
+
+static int order[MAX_BLOCKS];
+
+/* Working set sizes, in sectors. */
+static const size_t set_sizes[] = {16, 64, 256, MAX_BLOCKS};
+
+/* Fills BLOCK with the contents of sector IDX of the file. */
+static void
+fill_block (char block[BLOCK_SIZE], size_t idx) 
+{
+  size_t i;
+
+  for (i = 0; i < BLOCK_SIZE; i++)
+    block[i] = idx * 7 + i;
+}
+
+/* Reads sectors of FD in the order given by ORDER[0...BLOCK_CNT),
+   checking their contents. */
+static void
+read_blocks (int fd, size_t block_cnt) 
+{
+  size_t j;
+
+  for (j = 0; j < block_cnt; j++)
+    {
+      char block[BLOCK_SIZE], expected[BLOCK_SIZE];
+      size_t ofs = BLOCK_SIZE * order[j];
+      seek (fd, ofs);
+      if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read %d bytes at offset %zu failed",
+              (int) BLOCK_SIZE, ofs);
+      fill_block (expected, order[j]);
+      compare_bytes (block, expected, BLOCK_SIZE, ofs, "stress");
+    }
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "stress";
+  int fd;
+  size_t i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < MAX_BLOCKS; i++)
+    {
+      char block[BLOCK_SIZE];
+
+      fill_block (block, i);
+      if (write (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("write sector %zu of \"%s\" failed", i, file_name);
+    }
+  msg ("write \"%s\"", file_name);
+
+  for (i = 0; i < sizeof set_sizes / sizeof *set_sizes; i++)
+    {
+      size_t block_cnt = set_sizes[i];
+      size_t pass_cnt = READ_CNT / block_cnt;
+      struct cache_stats before, after;
+      size_t pass, j;
+
+      for (j = 0; j < block_cnt; j++)
+        order[j] = j;
+      read_blocks (fd, block_cnt);
+
+      msg ("re-read %zu sectors %zu times", block_cnt, pass_cnt);
+      CHECK (cache_stats (&before), "snapshot cache counters");
+      for (pass = 0; pass < pass_cnt; pass++)
+        {
+          shuffle (order, block_cnt, sizeof *order);
+          read_blocks (fd, block_cnt);
+        }
+      CHECK (cache_stats (&after), "snapshot cache counters again");
+      msg ("phase: %d reads of %zu sectors in %llu ticks",
+           READ_CNT, block_cnt, after.ticks - before.ticks);
+
+      if (after.misses != before.misses)
+        fail ("re-reading %zu sectors counted %llu misses",
+              block_cnt, after.misses - before.misses);
+      if (after.hits - before.hits < READ_CNT)
+        fail ("re-reading %zu sectors %zu times counted %llu hits",
+              block_cnt, pass_cnt, after.hits - before.hits);
+      msg ("all re-reads of %zu sectors hit", block_cnt);
+    }
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,36 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Ticks of each phase are informational only.
+@output = grep (!/^\(cache-stress\) phase: /, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cache-stress) begin
+(cache-stress) create "stress"
+(cache-stress) open "stress"
+(cache-stress) write "stress"
+(cache-stress) re-read 16 sectors 256 times
+(cache-stress) snapshot cache counters
+(cache-stress) snapshot cache counters again
+(cache-stress) all re-reads of 16 sectors hit
+(cache-stress) re-read 64 sectors 64 times
+(cache-stress) snapshot cache counters
+(cache-stress) snapshot cache counters again
+(cache-stress) all re-reads of 64 sectors hit
+(cache-stress) re-read 256 sectors 16 times
+(cache-stress) snapshot cache counters
+(cache-stress) snapshot cache counters again
+(cache-stress) all re-reads of 256 sectors hit
+(cache-stress) re-read 512 sectors 8 times
+(cache-stress) snapshot cache counters
+(cache-stress) snapshot cache counters again
+(cache-stress) all re-reads of 512 sectors hit
+(cache-stress) close "stress"
+(cache-stress) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Child process for syn-scale test.
+   Reads the whole test file a sector at a time several times
+   over, starting from a sector chosen by its index, so that
+   concurrent children mostly touch different sectors. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-scale.h"
+
+const char *test_name = "child-syn-scale";
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+  int fd;
+  size_t pass, i;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < PASS_CNT; pass++)
+    for (i = 0; i < BLOCK_CNT; i++) 
+      {
+        char block[BLOCK_SIZE];
+        size_t ofs = BLOCK_SIZE * ((i + child_idx * 7) % BLOCK_CNT);
+        seek (fd, ofs);
+        CHECK (read (fd, block, BLOCK_SIZE) == BLOCK_SIZE,
+               "read \"%s\"", file_name);
+        compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, file_name);
+      }
+  close (fd);
+
+  return child_idx;
+}
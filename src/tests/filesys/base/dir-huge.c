@@ -0,0 +1,61 @@
+/* Creates 10,000 files in one directory, then looks up, removes
+   and re-creates a sample of them, to exercise directory hash
+   index. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10000
+
+void
+test_main (void) 
+{
+  char name[32];
+  int fd;
+  int i;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+
+  msg ("creating %d files in \"big\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "big/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("opening sample");
+  for (i = 0; i < FILE_CNT; i += 113) 
+    {
+      snprintf (name, sizeof name, "big/f%d", i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  if (open ("big/f10000") != -1)
+    fail ("open of nonexistent file succeeded");
+
+  msg ("removing sample");
+  for (i = 0; i < FILE_CNT; i += 7) 
+    {
+      snprintf (name, sizeof name, "big/f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+      if (open (name) != -1)
+        fail ("open of removed \"%s\" succeeded", name);
+    }
+
+  msg ("re-creating sample");
+  for (i = 0; i < FILE_CNT; i += 7) 
+    {
+      snprintf (name, sizeof name, "big/f%d", i);
+      if (!create (name, 0))
+        fail ("re-create \"%s\" failed", name);
+      if (create (name, 0))
+        fail ("duplicate create \"%s\" succeeded", name);
+    }
+  CHECK ((fd = open ("big/f9996")) > 1, "open \"big/f9996\"");
+  close (fd);
+}
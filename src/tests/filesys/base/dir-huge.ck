@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-huge) begin
+(dir-huge) mkdir "big"
+(dir-huge) creating 10000 files in "big"
+(dir-huge) opening sample
+(dir-huge) removing sample
+(dir-huge) re-creating sample
+(dir-huge) open "big/f9996"
+(dir-huge) end
+EOF
+pass;
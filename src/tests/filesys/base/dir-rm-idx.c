@@ -0,0 +1,49 @@
+/* Resolves a path through ".." of a subdirectory of a directory
+   large enough to have a hash index, removes the subdirectory and
+   makes new directories, which may take its sector, then checks
+   that paths through ".." of those resolve to their own parents. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 70
+
+void
+test_main (void) 
+{
+  char name[32];
+  int fd;
+  int i;
+
+  CHECK (mkdir ("p"), "mkdir \"p\"");
+  CHECK (mkdir ("q"), "mkdir \"q\"");
+  CHECK (create ("q/only-q", 0), "create \"q/only-q\"");
+  msg ("creating %d files in \"p\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "p/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  CHECK (mkdir ("p/sub"), "mkdir \"p/sub\"");
+  CHECK ((fd = open ("p/sub/../f1")) > 1, "open \"p/sub/../f1\"");
+  close (fd);
+  CHECK (open ("p/sub/missing") == -1, "open \"p/sub/missing\" fails");
+  CHECK (remove ("p/sub"), "remove \"p/sub\"");
+  CHECK (open ("p/sub/../f1") == -1, "open through removed \"p/sub\" fails");
+
+  CHECK (mkdir ("q/n"), "mkdir \"q/n\"");
+  CHECK ((fd = open ("q/n/../only-q")) > 1, "open \"q/n/../only-q\"");
+  close (fd);
+  CHECK (open ("q/n/../f1") == -1, "open \"q/n/../f1\" fails");
+
+  CHECK (mkdir ("p/sub"), "mkdir \"p/sub\" again");
+  CHECK ((fd = open ("p/sub/../f1")) > 1, "open \"p/sub/../f1\" again");
+  close (fd);
+  CHECK (create ("p/sub/missing", 0), "create \"p/sub/missing\"");
+  CHECK ((fd = open ("p/sub/missing")) > 1, "open \"p/sub/missing\"");
+  close (fd);
+}
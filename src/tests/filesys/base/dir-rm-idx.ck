@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-rm-idx) begin
+(dir-rm-idx) mkdir "p"
+(dir-rm-idx) mkdir "q"
+(dir-rm-idx) create "q/only-q"
+(dir-rm-idx) creating 70 files in "p"
+(dir-rm-idx) mkdir "p/sub"
+(dir-rm-idx) open "p/sub/../f1"
+(dir-rm-idx) open "p/sub/missing" fails
+(dir-rm-idx) remove "p/sub"
+(dir-rm-idx) open through removed "p/sub" fails
+(dir-rm-idx) mkdir "q/n"
+(dir-rm-idx) open "q/n/../only-q"
+(dir-rm-idx) open "q/n/../f1" fails
+(dir-rm-idx) mkdir "p/sub" again
+(dir-rm-idx) open "p/sub/../f1" again
+(dir-rm-idx) create "p/sub/missing"
+(dir-rm-idx) open "p/sub/missing"
+(dir-rm-idx) end
+EOF
+pass;
@@ -0,0 +1,83 @@
+/* Writes a file, forces it to disk with fsync() and fdatasync(),
+   and checks that it reads back intact.  Buffer cache counters
+   show that each call writes sectors back, and that fdatasync()
+   after overwriting data in place writes the data sector alone,
+   leaving the unchanged inode sector be.  Also checks that
+   syncing a descriptor that is not open fails. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 16
+
+static char buf[BLOCK_SIZE * (BLOCK_CNT + 1)];
+static char buf2[BLOCK_SIZE * (BLOCK_CNT + 1)];
+
+/* Returns number of sectors written back since BEFORE. */
+static unsigned long long
+writebacks_since (const struct cache_stats *before) 
+{
+  struct cache_stats now;
+
+  cache_stats (&now);
+  return now.writebacks - before->writebacks;
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "sync";
+  struct cache_stats before;
+  unsigned long long cnt;
+  int fd, root_fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, BLOCK_SIZE * BLOCK_CNT) == BLOCK_SIZE * BLOCK_CNT,
+         "write \"%s\"", file_name);
+  cache_stats (&before);
+  CHECK (fsync (fd) == 0, "fsync \"%s\"", file_name);
+  if (writebacks_since (&before) == 0)
+    fail ("fsync wrote nothing back");
+
+  /* Leave no dirty sector behind but those written below. */
+  CHECK ((root_fd = open ("/")) > 1, "open \"/\"");
+  CHECK (fsync (root_fd) == 0, "fsync \"/\"");
+  close (root_fd);
+
+  random_bytes (buf, BLOCK_SIZE);
+  seek (fd, 0);
+  cache_stats (&before);
+  CHECK (write (fd, buf, BLOCK_SIZE) == BLOCK_SIZE,
+         "overwrite first block of \"%s\"", file_name);
+  CHECK (fdatasync (fd) == 0, "fdatasync \"%s\"", file_name);
+  cnt = writebacks_since (&before);
+  if (cnt != 1)
+    fail ("fdatasync after overwrite wrote %llu sectors back, not 1", cnt);
+
+  seek (fd, BLOCK_SIZE * BLOCK_CNT);
+  cache_stats (&before);
+  CHECK (write (fd, buf + BLOCK_SIZE * BLOCK_CNT, BLOCK_SIZE) == BLOCK_SIZE,
+         "extend \"%s\"", file_name);
+  CHECK (fsync (fd) == 0, "fsync \"%s\" again", file_name);
+  cnt = writebacks_since (&before);
+  if (cnt < 2)
+    fail ("fsync after extending wrote %llu sectors back, "
+          "not data and inode", cnt);
+
+  seek (fd, 0);
+  CHECK (read (fd, buf2, sizeof buf2) == sizeof buf2,
+         "read \"%s\"", file_name);
+  compare_bytes (buf2, buf, sizeof buf, 0, file_name);
+
+  CHECK (fsync (fd + 1) == -1, "fsync of unopened fd fails");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync) begin
+(fsync) create "sync"
+(fsync) open "sync"
+(fsync) write "sync"
+(fsync) fsync "sync"
+(fsync) open "/"
+(fsync) fsync "/"
+(fsync) overwrite first block of "sync"
+(fsync) fdatasync "sync"
+(fsync) extend "sync"
+(fsync) fsync "sync" again
+(fsync) read "sync"
+(fsync) fsync of unopened fd fails
+(fsync) close "sync"
+(fsync) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Creates files and a subdirectory in a directory, then lists it
+   with getdents() a few entries at a time and checks that every
+   entry is returned once, with the right type and inumber. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+void
+test_main (void) 
+{
+  struct dirent entries[7];
+  bool seen[FILE_CNT + 1];
+  char name[32];
+  int dir_fd, fd;
+  int cnt, total = 0;
+  int i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (mkdir ("d/sub"), "mkdir \"d/sub\"");
+  msg ("creating %d files in \"d\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "d/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  CHECK ((fd = open ("d/f0")) > 1, "open \"d/f0\"");
+  CHECK (getdents (fd, entries, 7) == -1, "getdents on file fails");
+
+  memset (seen, 0, sizeof seen);
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  while ((cnt = getdents (dir_fd, entries, 7)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        struct dirent *e = &entries[i];
+        int n;
+
+        if (!strcmp (e->name, "sub"))
+          {
+            if (!e->isdir)
+              fail ("\"sub\" is not a directory");
+            n = FILE_CNT;
+          }
+        else
+          {
+            n = atoi (e->name + 1);
+            if (e->name[0] != 'f' || n < 0 || n >= FILE_CNT || e->isdir)
+              fail ("unexpected entry \"%s\"", e->name);
+            if (n == 0 && e->inumber != inumber (fd))
+              fail ("wrong inumber for \"%s\"", e->name);
+          }
+        if (seen[n])
+          fail ("entry \"%s\" returned twice", e->name);
+        seen[n] = true;
+        total++;
+      }
+  if (cnt != 0)
+    fail ("getdents failed");
+  if (total != FILE_CNT + 1)
+    fail ("listed %d entries, expected %d", total, FILE_CNT + 1);
+  msg ("listed %d entries", total);
+  CHECK (getdents (dir_fd, entries, 7) == 0, "getdents at end returns 0");
+  close (dir_fd);
+  close (fd);
+}
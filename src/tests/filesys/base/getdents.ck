@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents) begin
+(getdents) mkdir "d"
+(getdents) mkdir "d/sub"
+(getdents) creating 40 files in "d"
+(getdents) open "d/f0"
+(getdents) getdents on file fails
+(getdents) open "d"
+(getdents) listed 41 entries
+(getdents) getdents at end returns 0
+(getdents) end
+EOF
+pass;
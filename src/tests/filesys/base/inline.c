@@ -0,0 +1,63 @@
+/* Writes a small file, held inline in its inode, then grows it
+   past what the inode holds, both by appending and by writing
+   well past its end, and checks the data after each step. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL 100
+#define LARGE 1000
+#define SPARSE 2000
+
+static char buf[SPARSE + SMALL];
+static char check[SPARSE + SMALL];
+
+static void
+verify (int fd, size_t size, const char *what) 
+{
+  seek (fd, 0);
+  memset (check, 0xcc, sizeof check);
+  if (read (fd, check, size) != (int) size)
+    fail ("short read of \"%s\"", what);
+  if (memcmp (buf, check, size))
+    fail ("\"%s\" data differ", what);
+  msg ("verified %zu bytes of \"%s\"", size, what);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("small", 0), "create \"small\"");
+  CHECK ((fd = open ("small")) > 1, "open \"small\"");
+  CHECK (write (fd, buf, SMALL) == SMALL, "write %d bytes", SMALL);
+  verify (fd, SMALL, "small");
+
+  CHECK (write (fd, buf + SMALL, LARGE - SMALL) == LARGE - SMALL,
+         "append %d bytes", LARGE - SMALL);
+  verify (fd, LARGE, "small");
+  close (fd);
+
+  CHECK (create ("sparse", SMALL), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  CHECK (write (fd, buf, SMALL) == SMALL, "write %d bytes", SMALL);
+  memset (buf + SMALL, 0, SPARSE - SMALL);
+  seek (fd, SPARSE);
+  CHECK (write (fd, buf + SPARSE, SMALL) == SMALL,
+         "write %d bytes at %d", SMALL, SPARSE);
+  verify (fd, SPARSE + SMALL, "sparse");
+  close (fd);
+
+  CHECK ((fd = open ("small")) > 1, "reopen \"small\"");
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  verify (fd, LARGE, "small");
+  close (fd);
+}
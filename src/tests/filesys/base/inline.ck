@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(inline) begin
+(inline) create "small"
+(inline) open "small"
+(inline) write 100 bytes
+(inline) verified 100 bytes of "small"
+(inline) append 900 bytes
+(inline) verified 1000 bytes of "small"
+(inline) create "sparse"
+(inline) open "sparse"
+(inline) write 100 bytes
+(inline) write 100 bytes at 2000
+(inline) verified 2100 bytes of "sparse"
+(inline) reopen "small"
+(inline) verified 1000 bytes of "small"
+(inline) end
+EOF
+pass;
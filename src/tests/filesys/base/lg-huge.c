@@ -0,0 +1,64 @@
+/* Writes a file larger than the 8 MB that direct and indirect
+   sectors can map, then checks its size and reads back blocks
+   spread over the whole file, including past 8 MB. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 8192
+#define CHUNK_CNT 1152                  /* 9 MB. */
+
+static char buf[CHUNK_SIZE];
+static char buf2[CHUNK_SIZE];
+
+/* Fills BUF with the pattern of chunk IDX. */
+static void
+fill_chunk (char *buf, int idx) 
+{
+  size_t i;
+
+  for (i = 0; i < CHUNK_SIZE; i++)
+    buf[i] = (idx * 31 + i / 512) & 0xff;
+}
+
+/* Reads back chunk IDX of FD and checks its contents. */
+static void
+check_chunk (int fd, int idx) 
+{
+  fill_chunk (buf, idx);
+  seek (fd, idx * CHUNK_SIZE);
+  if (read (fd, buf2, CHUNK_SIZE) != CHUNK_SIZE)
+    fail ("read of chunk %d failed", idx);
+  if (memcmp (buf, buf2, CHUNK_SIZE))
+    fail ("chunk %d differs", idx);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "huge";
+  int fd;
+  int i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  msg ("writing \"%s\"", file_name);
+  for (i = 0; i < CHUNK_CNT; i++) 
+    {
+      fill_chunk (buf, i);
+      if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write of chunk %d failed", i);
+    }
+  CHECK (filesize (fd) == CHUNK_SIZE * CHUNK_CNT, "filesize \"%s\"", file_name);
+
+  msg ("checking \"%s\"", file_name);
+  for (i = 0; i < CHUNK_CNT; i += 97)
+    check_chunk (fd, i);
+  check_chunk (fd, CHUNK_CNT - 1);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-huge) begin
+(lg-huge) create "huge"
+(lg-huge) open "huge"
+(lg-huge) writing "huge"
+(lg-huge) filesize "huge"
+(lg-huge) checking "huge"
+(lg-huge) close "huge"
+(lg-huge) end
+EOF
+pass;
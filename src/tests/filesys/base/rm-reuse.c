@@ -0,0 +1,45 @@
+/* Writes a file taking most of the disk, removes it, and writes
+   another as large, three times over, so that each file fits only
+   once the blocks of the one removed before are free again. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 8192
+#define CHUNK_CNT 160                   /* 1.25 MB. */
+#define ROUND_CNT 3
+
+static char buf[CHUNK_SIZE];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int round;
+
+  for (round = 0; round < ROUND_CNT; round++) 
+    {
+      int fd;
+      int i;
+
+      snprintf (name, sizeof name, "big%d", round);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      memset (buf, round + 1, sizeof buf);
+      for (i = 0; i < CHUNK_CNT; i++)
+        if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+          fail ("write of chunk %d of \"%s\" failed", i, name);
+      msg ("wrote \"%s\"", name);
+
+      seek (fd, (CHUNK_CNT - 1) * CHUNK_SIZE);
+      memset (buf, 0, sizeof buf);
+      if (read (fd, buf, CHUNK_SIZE) != CHUNK_SIZE || buf[0] != round + 1
+          || buf[CHUNK_SIZE - 1] != round + 1)
+        fail ("last chunk of \"%s\" differs", name);
+      close (fd);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+}
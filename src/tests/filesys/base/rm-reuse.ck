@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rm-reuse) begin
+(rm-reuse) create "big0"
+(rm-reuse) open "big0"
+(rm-reuse) wrote "big0"
+(rm-reuse) remove "big0"
+(rm-reuse) create "big1"
+(rm-reuse) open "big1"
+(rm-reuse) wrote "big1"
+(rm-reuse) remove "big1"
+(rm-reuse) create "big2"
+(rm-reuse) open "big2"
+(rm-reuse) wrote "big2"
+(rm-reuse) remove "big2"
+(rm-reuse) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Spawns growing numbers of child processes, 1, 2, 4 and then 8,
+   all of which read the same cached file at once, each starting
+   from a different sector.  Readers of different sectors do not
+   serialize in the buffer cache.
+
+   Each round reports the timer ticks it took, from starting the
+   children to reaping them, and the sectors read per 100 ticks,
+   along with the buffer cache lookups it caused.  Pintos runs on
+   a single CPU, so concurrent readers cannot add throughput;
+   scaling shows as sectors per 100 ticks holding steady rather
+   than falling as readers contend in the cache.  The figures
+   vary between runs and simulators, so syn-scale.ck does not
+   compare them. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-scale.h"
+
+static char buf[BUF_SIZE];
+
+#define MAX_CHILD_CNT 8
+
+void
+test_main (void) 
+{
+  pid_t children[MAX_CHILD_CNT];
+  struct cache_stats before, after;
+  unsigned long long ticks, sectors;
+  size_t child_cnt;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) > 0, "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  for (child_cnt = 1; child_cnt <= MAX_CHILD_CNT; child_cnt *= 2)
+    {
+      msg ("%zu concurrent reader(s)", child_cnt);
+      cache_stats (&before);
+      exec_children ("child-syn-scale", children, child_cnt);
+      wait_children (children, child_cnt);
+      cache_stats (&after);
+      ticks = after.ticks - before.ticks;
+      sectors = child_cnt * BLOCK_CNT * PASS_CNT;
+      msg ("round: %zu reader(s) read %llu sectors in %llu ticks, "
+           "%llu per 100 ticks",
+           child_cnt, sectors, ticks, sectors * 100 / (ticks > 0 ? ticks : 1));
+      msg ("round: %zu reader(s), %llu hits, %llu misses, %llu flushes",
+           child_cnt, after.hits - before.hits,
+           after.misses - before.misses, after.flushes - before.flushes);
+    }
+}
@@ -0,0 +1,54 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Per-round cache counters are informational only.
+@output = grep (!/^\(syn-scale\) round: /, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(syn-scale) begin
+(syn-scale) create "scale"
+(syn-scale) open "scale"
+(syn-scale) write "scale"
+(syn-scale) close "scale"
+(syn-scale) 1 concurrent reader(s)
+(syn-scale) exec child 1 of 1: "child-syn-scale 0"
+(syn-scale) wait for child 1 of 1 returned 0 (expected 0)
+(syn-scale) 2 concurrent reader(s)
+(syn-scale) exec child 1 of 2: "child-syn-scale 0"
+(syn-scale) exec child 2 of 2: "child-syn-scale 1"
+(syn-scale) wait for child 1 of 2 returned 0 (expected 0)
+(syn-scale) wait for child 2 of 2 returned 1 (expected 1)
+(syn-scale) 4 concurrent reader(s)
+(syn-scale) exec child 1 of 4: "child-syn-scale 0"
+(syn-scale) exec child 2 of 4: "child-syn-scale 1"
+(syn-scale) exec child 3 of 4: "child-syn-scale 2"
+(syn-scale) exec child 4 of 4: "child-syn-scale 3"
+(syn-scale) wait for child 1 of 4 returned 0 (expected 0)
+(syn-scale) wait for child 2 of 4 returned 1 (expected 1)
+(syn-scale) wait for child 3 of 4 returned 2 (expected 2)
+(syn-scale) wait for child 4 of 4 returned 3 (expected 3)
+(syn-scale) 8 concurrent reader(s)
+(syn-scale) exec child 1 of 8: "child-syn-scale 0"
+(syn-scale) exec child 2 of 8: "child-syn-scale 1"
+(syn-scale) exec child 3 of 8: "child-syn-scale 2"
+(syn-scale) exec child 4 of 8: "child-syn-scale 3"
+(syn-scale) exec child 5 of 8: "child-syn-scale 4"
+(syn-scale) exec child 6 of 8: "child-syn-scale 5"
+(syn-scale) exec child 7 of 8: "child-syn-scale 6"
+(syn-scale) exec child 8 of 8: "child-syn-scale 7"
+(syn-scale) wait for child 1 of 8 returned 0 (expected 0)
+(syn-scale) wait for child 2 of 8 returned 1 (expected 1)
+(syn-scale) wait for child 3 of 8 returned 2 (expected 2)
+(syn-scale) wait for child 4 of 8 returned 3 (expected 3)
+(syn-scale) wait for child 5 of 8 returned 4 (expected 4)
+(syn-scale) wait for child 6 of 8 returned 5 (expected 5)
+(syn-scale) wait for child 7 of 8 returned 6 (expected 6)
+(syn-scale) wait for child 8 of 8 returned 7 (expected 7)
+(syn-scale) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BASE_SYN_SCALE_H
+#define TESTS_FILESYS_BASE_SYN_SCALE_H
+
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 48
+#define BUF_SIZE (BLOCK_SIZE * BLOCK_CNT)
+#define PASS_CNT 16
+static const char file_name[] = "scale";
+
+#endif /* tests/filesys/base/syn-scale.h */
@@ -36,6 +36,7 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/cache.h"
 #endif
 /* Project3 S */
 #ifdef VM
@@ -268,6 +269,18 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        {
+          if (value == NULL || atoi (value) <= 0
+              || !cache_set_size (atoi (value)))
+            PANIC ("bad -cache value `%s' (use 1 to %zu sectors)",
+                   value, cache_max_size ());
+        }
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (value == NULL || !cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use clock or 2q)", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -394,6 +407,8 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=N           Cache up to N disk sectors, 1/4 of RAM at most.\n"
+          "  -cache-policy=P    Use replacement policy P (clock or 2q) for cache.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
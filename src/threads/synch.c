@@ -336,3 +336,94 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Project4 S */
+/* Initializes RW as a reader-writer lock, held by no one. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writer_ok);
+  rw->readers = 0;
+  rw->writers_waiting = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   waits for it.  The same thread must not acquire RW for reading
+   again before releasing it, since a writer may be waiting in
+   between. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->writers_waiting > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->writer_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until neither readers nor
+   another writer hold it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writers_waiting++;
+  while (rw->writer != NULL || rw->readers > 0)
+    cond_wait (&rw->writer_ok, &rw->lock);
+  rw->writers_waiting--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing.
+   Hands it to the next writer if any waits, or else to every
+   waiting reader. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (rw->writers_waiting > 0)
+    cond_signal (&rw->writer_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+/* Project4 E */
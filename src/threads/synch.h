@@ -41,6 +41,28 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Project4 S */
+/* Reader-writer lock.  Any number of readers or a single writer
+   may hold it at once.  Waiting writers keep new readers out, so
+   that a stream of readers cannot starve them. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects members below. */
+    struct condition readers_ok;/* Signaled when readers may go on. */
+    struct condition writer_ok; /* Signaled when a writer may go on. */
+    unsigned readers;           /* Number of readers holding. */
+    unsigned writers_waiting;   /* Number of writers waiting. */
+    struct thread *writer;      /* Writer holding, if any. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+/* Project4 E */
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -23,6 +23,7 @@
 /* Project4 S */
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#include "filesys/cache.h"
 /* Project4 E */
 
 static void syscall_handler (struct intr_frame *);
@@ -54,6 +55,9 @@ static bool sys_mkdir(const char* dir);
 static bool sys_readdir(int fd, char* name);
 static bool sys_isdir(int fd);
 static int sys_inumber(int fd);
+static int sys_fsync(int fd, bool data_only);
+static int sys_getdents(int fd, struct dirent* entries, unsigned cnt);
+static bool sys_cache_stats(struct cache_stats* stats);
 /* Project4 E */
 
 void
@@ -197,6 +201,32 @@ syscall_handler (struct intr_frame *f)
 			f->eax = sys_inumber(fd);
 			break;
 		}
+		case SYS_FSYNC:
+		{
+			int fd = read_stack(++esp);
+			f->eax = sys_fsync(fd, false);
+			break;
+		}
+		case SYS_FDATASYNC:
+		{
+			int fd = read_stack(++esp);
+			f->eax = sys_fsync(fd, true);
+			break;
+		}
+		case SYS_GETDENTS:
+		{
+			int fd = read_stack(++esp);
+			struct dirent* entries = (struct dirent*)read_stack(++esp);
+			unsigned cnt = read_stack(++esp);
+			f->eax = sys_getdents(fd, entries, cnt);
+			break;
+		}
+		case SYS_CACHE_STATS:
+		{
+			struct cache_stats* stats = (struct cache_stats*)read_stack(++esp);
+			f->eax = sys_cache_stats(stats);
+			break;
+		}
 		default:
 			NOT_REACHED();
 	}
@@ -271,6 +301,22 @@ write_buffer(void* buffer, uint8_t byte)
 	return is_user_vaddr(buffer) && put_user(buffer, byte);
 }
 
+/* Project4 S */
+/* Copy SIZE bytes from SRC into user buffer UDST.
+	 Returns false if a segfault occurred */
+static bool 
+copy_to_user(void* udst, const void* src, size_t size)
+{
+	const uint8_t* bytes = src;
+	size_t i;
+
+	for(i = 0; i < size; i++)
+		if(!write_buffer((uint8_t*)udst + i, bytes[i]))
+			return false;
+	return true;
+}
+/* Project4 E */
+
 static void 
 sys_halt(void)
 {
@@ -363,24 +409,19 @@ sys_read(int fd, void* buffer, unsigned size)
 			return -1;
 		default:
 		{
-			unsigned readsize;
-			uint8_t* bytes;
+			int readsize;
 			void* file;
 
 			if(fd_get_data(fd, &file))
 				return -1;
 
-			bytes = malloc(size);
-			readsize = file_read(file, bytes, size);
-
-			for(i = 0; i < readsize; i++)
-				if(!write_buffer(buffer + i, bytes[i]))
-				{
-					free(bytes);
-					sys_exit(-1);
-				}
+			/* Project4 S */
+			/* Copy straight from buffer cache into user buffer */
+			readsize = file_read_to(file, buffer, size, copy_to_user);
+			if(readsize < 0)
+				sys_exit(-1);
+			/* Project4 E */
 
-			free(bytes);
 			return readsize;
 		}
 	}
@@ -590,4 +631,64 @@ sys_inumber(int fd)
 	else
 		return inode_get_inumber(file_get_inode(data));
 }
+
+/* Write back FD's dirty sectors, see inode_sync() for DATA_ONLY.
+	 Returns 0 once they are on disk, -1 if FD is not open */
+static int 
+sys_fsync(int fd, bool data_only)
+{
+	void* data = NULL;
+	bool isdir = fd_get_data(fd, &data);
+
+	if(data == NULL)
+		return -1;
+
+	if(isdir)
+		inode_sync(dir_get_inode(data), data_only);
+	else
+		inode_sync(file_get_inode(data), data_only);
+	return 0;
+}
+
+/* Read up to CNT entries of directory FD into ENTRIES, at most a
+	 page's worth per call. Returns number of entries read, 0 at end
+	 of directory, -1 if FD is not an open directory */
+static int 
+sys_getdents(int fd, struct dirent* entries, unsigned cnt)
+{
+	void* dir = NULL;
+	struct dirent* buf;
+	size_t n;
+
+	if(!fd_get_data(fd, &dir) || dir == NULL)
+		return -1;
+
+	if(cnt > PGSIZE / sizeof *buf)
+		cnt = PGSIZE / sizeof *buf;
+	if(cnt == 0)
+		return 0;
+
+	buf = malloc(cnt * sizeof *buf);
+	if(buf == NULL)
+		return -1;
+	n = dir_readdir_batch(dir, buf, cnt);
+	if(!copy_to_user(entries, buf, n * sizeof *buf))
+	{
+		free(buf);
+		sys_exit(-1);
+	}
+	free(buf);
+	return n;
+}
+
+static bool 
+sys_cache_stats(struct cache_stats* stats)
+{
+	struct cache_stats snapshot;
+
+	cache_get_stats(&snapshot);
+	if(!copy_to_user(stats, &snapshot, sizeof snapshot))
+		sys_exit(-1);
+	return true;
+}
 /* Project4 E */
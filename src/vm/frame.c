@@ -5,6 +5,7 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "vm/swap.h"
+#include "filesys/cache.h"
 
 /* Frame table list variables */
 static struct list frame_table;
@@ -23,6 +24,10 @@ void*
 frame_allocate (enum palloc_flags flags)
 {
 	void* kpage = palloc_get_page(PAL_USER | flags);
+
+	/* Take pages back from buffer cache before swapping */
+	while(kpage == NULL && cache_shrink())
+		kpage = palloc_get_page(PAL_USER | flags);
 	
 	if(kpage == NULL)
 		return swap_out();